@@ -0,0 +1,203 @@
+#include <QSet>
+
+#include "asyncstore.hh"
+#include "metrics.hh"
+
+AsyncStore::AsyncStore(Storage *backing, QObject *backingObject, Durability policy, int syncInterval)
+{
+  this->backing = backing;
+  this->backingObject = backingObject;
+  this->policy = policy;
+  scheduled = false;
+  ticket = 0;
+  written = 0;
+  synced = 0;
+  io = new QThread();
+
+  syncTimer = new QTimer(this);
+  syncTimer->setInterval(syncInterval);
+  connect(syncTimer, SIGNAL(timeout()), this, SLOT(syncWritten()));
+}
+
+// writes and syncs what is still pending before the thread goes away
+AsyncStore::~AsyncStore()
+{
+  if (io->isRunning()) {
+    // flush and let the backing store die on the thread that owns its timers
+    QMetaObject::invokeMethod(this, "writePending", Qt::BlockingQueuedConnection);
+    QMetaObject::invokeMethod(this, "syncWritten", Qt::BlockingQueuedConnection);
+    backingObject->deleteLater();
+    io->quit();
+    io->wait();
+  } else {
+    delete(backingObject);
+  }
+  delete(io);
+}
+
+// opens the backing store on the calling thread, then hands it to the io thread
+bool AsyncStore::open(QString dir)
+{
+  if (!backing->open(dir)) {
+    return false;
+  }
+
+  // moving the store along restarts the timer on the io thread
+  if (policy == kSyncInterval) {
+    syncTimer->start();
+  }
+  setParent(0);
+  moveToThread(io);
+  backingObject->moveToThread(io);
+  io->start();
+  return true;
+}
+
+void AsyncStore::put(QString key, int version, QString value)
+{
+  QMutexLocker locker(&mutex);
+  Update u;
+  u.version = version;
+  u.value = value;
+  pending.insert(key, u);
+  queued.append(key);
+  ++ticket;
+  Metrics::global()->storeQueue.set(pending.size());
+
+  if (!scheduled) {
+    scheduled = true;
+    QMetaObject::invokeMethod(this, "writePending", Qt::QueuedConnection);
+  }
+}
+
+// a tombstone is queued like any other put
+void AsyncStore::remove(QString key, int version)
+{
+  QMutexLocker locker(&mutex);
+  Update u;
+  u.version = version;
+  u.deleted = true;
+  pending.insert(key, u);
+  queued.append(key);
+  ++ticket;
+  Metrics::global()->storeQueue.set(pending.size());
+
+  if (!scheduled) {
+    scheduled = true;
+    QMetaObject::invokeMethod(this, "writePending", Qt::QueuedConnection);
+  }
+}
+
+QString AsyncStore::get(QString key)
+{
+  {
+    QMutexLocker locker(&mutex);
+    QHash<QString, Update>::const_iterator i = pending.constFind(key);
+    if (i != pending.constEnd()) {
+      return i.value().value; // empty for a tombstone
+    }
+  }
+  // not pending, so whatever the backing store has is the newest
+  return backing->get(key);
+}
+
+QHash<QString, int> AsyncStore::versions()
+{
+  QHash<QString, int> out = backing->versions();
+  QMutexLocker locker(&mutex);
+  for (QHash<QString, Update>::const_iterator i = pending.begin(); i != pending.end(); ++i) {
+    out.insert(i.key(), i.value().version);
+  }
+  return out;
+}
+
+QStringList AsyncStore::tombstones()
+{
+  QStringList out = backing->tombstones();
+  QMutexLocker locker(&mutex);
+  for (QHash<QString, Update>::const_iterator i = pending.begin(); i != pending.end(); ++i) {
+    if (i.value().deleted and !out.contains(i.key())) {
+      out.append(i.key());
+    } else if (!i.value().deleted) {
+      out.removeAll(i.key());
+    }
+  }
+  return out;
+}
+
+// the purge runs on the io thread after the writes queued before it
+void AsyncStore::purge(const QStringList &keys)
+{
+  QMetaObject::invokeMethod(this, "purgeBacking", Qt::QueuedConnection, Q_ARG(QStringList, keys));
+}
+
+// runs on the io thread
+void AsyncStore::purgeBacking(const QStringList &keys)
+{
+  writePending();
+  backing->purge(keys);
+}
+
+// ticket of the last put, it is durable once durable() reports it or a later one
+quint64 AsyncStore::lastTicket()
+{
+  QMutexLocker locker(&mutex);
+  return ticket;
+}
+
+// whether acks of puts have to wait for durable()
+bool AsyncStore::defersAcks() const
+{
+  return policy != kSyncNone;
+}
+
+// runs on the io thread, writes everything put so far as one batch
+void AsyncStore::writePending()
+{
+  PutBatch batch;
+  quint64 upto;
+  {
+    QMutexLocker locker(&mutex);
+    QSet<QString> seen;
+    for (int i = 0; i < queued.size(); ++i) {
+      // a key put twice goes out once, with its newest value
+      QHash<QString, Update>::const_iterator p = pending.constFind(queued.at(i));
+      if (p != pending.constEnd() and !seen.contains(p.key())) {
+        seen.insert(p.key());
+        batch.append(qMakePair(p.key(), p.value()));
+      }
+    }
+    queued.clear();
+    scheduled = false;
+    upto = ticket;
+  }
+
+  backing->putBatch(batch);
+
+  {
+    // only forget what no newer version was put for meanwhile
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < batch.size(); ++i) {
+      QHash<QString, Update>::iterator p = pending.find(batch.at(i).first);
+      if (p != pending.end() and p.value().version == batch.at(i).second.version) {
+        pending.erase(p);
+      }
+    }
+    Metrics::global()->storeQueue.set(pending.size());
+  }
+
+  written = upto;
+  if (policy == kSyncBatch) {
+    syncWritten();
+  }
+}
+
+// runs on the io thread, syncs the backing store if anything was written since the last time
+void AsyncStore::syncWritten()
+{
+  if (written == synced or !backing->sync()) {
+    return;
+  }
+  synced = written;
+  emit durable(synced);
+}
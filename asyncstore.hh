@@ -0,0 +1,73 @@
+#ifndef ASYNCSTORE_CLASS_HH
+#define ASYNCSTORE_CLASS_HH
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+#include "message.hh"
+#include "storage.hh"
+
+// when the writes of an AsyncStore are made durable
+enum Durability
+{
+  kSyncNone,     // never, the OS writes them back whenever it likes
+  kSyncInterval, // every syncInterval ms, if anything was written
+  kSyncBatch     // after every batch, before the next one is written
+};
+
+// Runs the writes of another store on a thread of their own, so a slow disk
+// never holds up the thread that calls put(). Until a write has reached the
+// backing store, get() answers it from memory.
+//
+// Every put gets a ticket, see lastTicket(). Puts that pile up while the io
+// thread is busy are written as one batch, so under load the number of
+// appends and syncs per second stays bounded while the batches grow.
+// durable(ticket) is emitted once every put up to ticket is synced.
+class AsyncStore : public QObject, public Storage
+{
+  Q_OBJECT
+
+  public:
+    AsyncStore(Storage *backing, QObject *backingObject,
+               Durability policy = kSyncNone, int syncInterval = 0);
+    ~AsyncStore();
+    bool open(QString dir);
+    void put(QString key, int version, QString value);
+    void remove(QString key, int version);
+    QString get(QString key);
+    QHash<QString, int> versions();
+    QStringList tombstones();
+    void purge(const QStringList &keys);
+    quint64 lastTicket();
+    bool defersAcks() const;
+
+  public slots:
+    void writePending();
+    void syncWritten();
+    void purgeBacking(const QStringList &keys);
+
+  signals:
+    void durable(quint64 ticket);
+
+  private:
+    Storage *backing;
+    QObject *backingObject; // the backing store as a QObject, moved along to the io thread
+    QThread *io;
+    Durability policy;
+    QTimer *syncTimer;      // lives on the io thread, kSyncInterval only
+
+    QMutex mutex; // guards pending, queued, scheduled and ticket
+    QHash<QString, Update> pending; // newest unwritten value of every key
+    QStringList queued;             // keys in the order they were put
+    bool scheduled;
+    quint64 ticket;                 // of the last put
+
+    // io thread only
+    quint64 written, synced;        // tickets up to which puts reached the backing store, and disk
+};
+
+#endif
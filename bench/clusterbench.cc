@@ -0,0 +1,438 @@
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QProcess>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QVector>
+#include <QtEndian>
+
+// Launches a cluster of headless nodes on localhost, drives a mix of puts
+// and gets through the client protocol and reports as JSON:
+//   - time to full replication of every put, polled by peeking at every
+//     node until as many hold the value as there are replicas
+//   - latency of the quorum reads
+//   - datagrams and bytes the nodes sent per put, from their counters
+//   - CPU seconds every node process used while the mix ran
+// Replication times are only as fine as one poll round, pollInterval ms
+// plus the time to ask the nodes about the pending puts. A node is only
+// asked about the puts it does not hold yet. The CPU the nodes spend
+// answering the polls is measured around every round and reported apart,
+// cpu_seconds is what is left for the workload.
+
+enum ClientOp
+{
+  kClientPut = 1,
+  kClientGet = 2,
+  kClientPeek = 6,
+  kClientStats = 7
+};
+
+struct Options
+{
+  QString node;      // node binary
+  int nodes;
+  int replicas;
+  int ops;
+  double getRatio;   // share of the ops that are gets
+  int valueSize;
+  int basePort;      // gossip ports from here, client ports from basePort + 1000
+  int settle;        // ms to let membership converge before the mix
+  int timeout;       // ms to wait for the puts to replicate after the mix
+  int pollInterval;  // ms between replication polls
+  QString out;       // JSON goes here, stdout if empty
+};
+
+// one client connection to a node, requests may be pipelined
+class Client
+{
+  public:
+    Client() : nextId(1) {}
+
+    bool connectTo(int port, int timeout)
+    {
+      QElapsedTimer clock;
+      clock.start();
+      while (clock.elapsed() < timeout) {
+        sock.connectToHost("127.0.0.1", port);
+        if (sock.waitForConnected(100)) {
+          sock.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+          return true;
+        }
+        sock.abort();
+        QThread::msleep(50);
+      }
+      return false;
+    }
+
+    quint32 send(quint8 op, const QString &key, const QString &value = QString())
+    {
+      quint32 id = nextId++;
+      QByteArray frame;
+      QDataStream out(&frame, QIODevice::WriteOnly);
+      out << (quint32)0 << id << op << key << value;
+      qToBigEndian<quint32>(frame.size() - 4, (uchar *)frame.data());
+      sock.write(frame);
+      return id;
+    }
+
+    // blocks until the reply to id arrived, replies to other ids are kept
+    QString wait(quint32 id)
+    {
+      while (!replies.contains(id)) {
+        if (!readReply()) {
+          return QString();
+        }
+      }
+      return replies.take(id);
+    }
+
+  private:
+    bool readReply()
+    {
+      sock.flush();
+      while (sock.bytesAvailable() < 4) {
+        if (!sock.waitForReadyRead(10000)) {
+          return false;
+        }
+      }
+      QByteArray header = sock.peek(4);
+      quint32 size = qFromBigEndian<quint32>((const uchar *)header.constData());
+      while (sock.bytesAvailable() < 4 + (qint64)size) {
+        if (!sock.waitForReadyRead(10000)) {
+          return false;
+        }
+      }
+      sock.read(4);
+      QDataStream in(sock.read(size));
+      quint32 id;
+      quint8 status;
+      QString value;
+      in >> id >> status >> value;
+      replies.insert(id, value);
+      return true;
+    }
+
+    QTcpSocket sock;
+    quint32 nextId;
+    QHash<quint32, QString> replies;
+};
+
+// a put waiting to show up on all of its replicas
+struct PendingPut
+{
+  QString key;
+  QString value;
+  qint64 start;     // ns
+  QVector<bool> on; // nodes seen holding it
+  int held;
+};
+
+static double percentile(QVector<double> samples, double p)
+{
+  if (samples.isEmpty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  int i = qMin(samples.size() - 1, (int)(p * samples.size()));
+  return samples.at(i);
+}
+
+// user plus system CPU seconds of a process so far
+static double cpuSeconds(qint64 pid)
+{
+  QFile stat(QString("/proc/%1/stat").arg(pid));
+  if (!stat.open(QIODevice::ReadOnly)) {
+    return 0;
+  }
+  // fields after the parenthesized command name, utime and stime are the 12th and 13th
+  QString line = QString::fromLatin1(stat.readAll());
+  QStringList fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+  if (fields.size() < 13) {
+    return 0;
+  }
+  return (fields.at(11).toDouble() + fields.at(12).toDouble()) / sysconf(_SC_CLK_TCK);
+}
+
+// the counters a node reports through kClientStats
+static QHash<QString, double> stats(Client *client)
+{
+  QHash<QString, double> out;
+  QStringList lines = client->wait(client->send(kClientStats, QString())).split('\n');
+  for (int i = 0; i < lines.size(); ++i) {
+    QStringList pair = lines.at(i).split(' ');
+    if (pair.size() == 2) {
+      out.insert(pair.at(0), pair.at(1).toDouble());
+    }
+  }
+  return out;
+}
+
+static double sum(const QList<QHash<QString, double> > &perNode, const QString &name)
+{
+  double total = 0;
+  for (int i = 0; i < perNode.size(); ++i) {
+    total += perNode.at(i).value(name);
+  }
+  return total;
+}
+
+// Asks every node about the pending puts it was not seen holding yet,
+// returns the puts that are on as many nodes as they should be with their
+// replication time in ms. The CPU seconds the nodes used meanwhile are
+// added to pollCpu.
+static QVector<double> poll(QList<Client *> &clients, QList<PendingPut> &pending, int copies,
+                            QElapsedTimer &clock, const QList<QProcess *> &procs,
+                            QVector<double> &pollCpu)
+{
+  QVector<double> cpuBefore;
+  for (int n = 0; n < procs.size(); ++n) {
+    cpuBefore.append(cpuSeconds(procs.at(n)->processId()));
+  }
+
+  QVector<QVector<quint32> > ids(clients.size());
+  for (int n = 0; n < clients.size(); ++n) {
+    ids[n].fill(0, pending.size());
+    for (int i = 0; i < pending.size(); ++i) {
+      if (!pending.at(i).on.at(n)) {
+        ids[n][i] = clients.at(n)->send(kClientPeek, pending.at(i).key);
+      }
+    }
+  }
+
+  for (int n = 0; n < clients.size(); ++n) {
+    for (int i = 0; i < pending.size(); ++i) {
+      if (ids.at(n).at(i) and clients.at(n)->wait(ids.at(n).at(i)) == pending.at(i).value) {
+        pending[i].on[n] = true;
+        ++pending[i].held;
+      }
+    }
+  }
+
+  for (int n = 0; n < procs.size(); ++n) {
+    pollCpu[n] += cpuSeconds(procs.at(n)->processId()) - cpuBefore.at(n);
+  }
+
+  QVector<double> done;
+  qint64 now = clock.nsecsElapsed();
+  QList<PendingPut> left;
+  for (int i = 0; i < pending.size(); ++i) {
+    if (pending.at(i).held >= copies) {
+      done.append((now - pending.at(i).start) / 1e6);
+    } else {
+      left.append(pending.at(i));
+    }
+  }
+  pending = left;
+  return done;
+}
+
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog
+            << " [--node PATH] [--nodes N] [--replicas N] [--ops N] [--get-ratio R]"
+            << " [--value-size BYTES] [--base-port PORT] [--settle MS] [--timeout MS]"
+            << " [--poll-interval MS] [--out FILE]" << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, Options &opt)
+{
+  opt.node = "../final";
+  opt.nodes = 5;
+  opt.replicas = 3;
+  opt.ops = 2000;
+  opt.getRatio = 0.5;
+  opt.valueSize = 100;
+  opt.basePort = 45000;
+  opt.settle = 3000;
+  opt.timeout = 30000;
+  opt.pollInterval = 50;
+
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    QString name = argv[i];
+    QString value = argv[++i];
+    if (name == "--node") {
+      opt.node = value;
+    } else if (name == "--nodes") {
+      opt.nodes = qMax(1, value.toInt());
+    } else if (name == "--replicas") {
+      opt.replicas = qMax(1, value.toInt());
+    } else if (name == "--ops") {
+      opt.ops = qMax(1, value.toInt());
+    } else if (name == "--get-ratio") {
+      opt.getRatio = qBound(0.0, value.toDouble(), 1.0);
+    } else if (name == "--value-size") {
+      opt.valueSize = qMax(1, value.toInt());
+    } else if (name == "--base-port") {
+      opt.basePort = value.toInt();
+    } else if (name == "--settle") {
+      opt.settle = value.toInt();
+    } else if (name == "--timeout") {
+      opt.timeout = value.toInt();
+    } else if (name == "--poll-interval") {
+      opt.pollInterval = qMax(1, value.toInt());
+    } else if (name == "--out") {
+      opt.out = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static QString json(const QString &name, double value)
+{
+  return QString("\"%1\": %2").arg(name).arg(value, 0, 'f', 3);
+}
+
+int main(int argc, char **argv)
+{
+  QCoreApplication app(argc, argv);
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // every node keeps its log under the working directory, give them a fresh one
+  QTemporaryDir dir;
+  QList<QProcess *> procs;
+  for (int n = 0; n < opt.nodes; ++n) {
+    QProcess *proc = new QProcess();
+    proc->setWorkingDirectory(dir.path());
+    proc->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    proc->setStandardOutputFile(QProcess::nullDevice());
+    proc->start(opt.node, QStringList()
+                << "--headless" << "--durability" << "none"
+                << "--port" << QString::number(opt.basePort + n)
+                << "--client-port" << QString::number(opt.basePort + 1000 + n)
+                << "--seeds" << QString("127.0.0.1:%1").arg(opt.basePort)
+                << "--replicas" << QString::number(opt.replicas));
+    if (!proc->waitForStarted()) {
+      std::cerr << "could not start " << opt.node.toStdString() << std::endl;
+      return 1;
+    }
+    procs.append(proc);
+  }
+
+  QList<Client *> clients;
+  for (int n = 0; n < opt.nodes; ++n) {
+    Client *client = new Client();
+    if (!client->connectTo(opt.basePort + 1000 + n, 10000)) {
+      std::cerr << "node " << n << " does not accept clients" << std::endl;
+      return 1;
+    }
+    clients.append(client);
+  }
+  QThread::msleep(opt.settle);
+
+  QList<QHash<QString, double> > before;
+  QVector<double> cpuBefore;
+  for (int n = 0; n < opt.nodes; ++n) {
+    before.append(stats(clients.at(n)));
+    cpuBefore.append(cpuSeconds(procs.at(n)->processId()));
+  }
+
+  srand(time(0));
+  QString filler(opt.valueSize, QChar('x'));
+  int copies = qMin(opt.replicas, opt.nodes);
+  QElapsedTimer clock;
+  clock.start();
+  QList<PendingPut> pending;
+  QStringList written;
+  QVector<double> replication, reads;
+  QVector<double> pollCpu(opt.nodes, 0);
+  int puts = 0;
+  qint64 lastPoll = 0;
+
+  for (int i = 0; i < opt.ops; ++i) {
+    Client *client = clients.at(rand() % clients.size());
+    if (!written.isEmpty() and rand() < opt.getRatio * RAND_MAX) {
+      qint64 start = clock.nsecsElapsed();
+      client->wait(client->send(kClientGet, written.at(rand() % written.size())));
+      reads.append((clock.nsecsElapsed() - start) / 1e6);
+    } else {
+      PendingPut put;
+      put.key = QString("bench-%1").arg(i);
+      put.value = QString::number(i) + filler;
+      put.start = clock.nsecsElapsed();
+      put.on.fill(false, opt.nodes);
+      put.held = 0;
+      client->wait(client->send(kClientPut, put.key, put.value));
+      pending.append(put);
+      written.append(put.key);
+      ++puts;
+    }
+
+    if (clock.elapsed() - lastPoll >= opt.pollInterval) {
+      replication += poll(clients, pending, copies, clock, procs, pollCpu);
+      lastPoll = clock.elapsed();
+    }
+  }
+  double mixSeconds = clock.elapsed() / 1000.0;
+
+  qint64 deadline = clock.elapsed() + opt.timeout;
+  while (!pending.isEmpty() and clock.elapsed() < deadline) {
+    QThread::msleep(opt.pollInterval);
+    replication += poll(clients, pending, copies, clock, procs, pollCpu);
+  }
+
+  QList<QHash<QString, double> > after;
+  QStringList cpu, polling;
+  for (int n = 0; n < opt.nodes; ++n) {
+    double used = cpuSeconds(procs.at(n)->processId()) - cpuBefore.at(n);
+    after.append(stats(clients.at(n)));
+    cpu.append(QString::number(qMax(0.0, used - pollCpu.at(n)), 'f', 3));
+    polling.append(QString::number(pollCpu.at(n), 'f', 3));
+  }
+  double datagrams = sum(after, "datagrams_sent") - sum(before, "datagrams_sent");
+  double bytes = sum(after, "bytes_sent") - sum(before, "bytes_sent");
+
+  QStringList fields;
+  fields << json("nodes", opt.nodes) << json("replicas", opt.replicas)
+         << json("ops", opt.ops) << json("puts", puts) << json("gets", reads.size())
+         << json("seconds", mixSeconds)
+         << json("ops_per_second", opt.ops / qMax(mixSeconds, 1e-3))
+         << json("unreplicated", pending.size())
+         << json("replication_ms_p50", percentile(replication, 0.5))
+         << json("replication_ms_p99", percentile(replication, 0.99))
+         << json("replication_ms_max", percentile(replication, 1.0))
+         << json("read_ms_p50", percentile(reads, 0.5))
+         << json("read_ms_p99", percentile(reads, 0.99))
+         << json("datagrams_per_put", datagrams / qMax(puts, 1))
+         << json("bytes_per_put", bytes / qMax(puts, 1))
+         << QString("\"cpu_seconds\": [%1]").arg(cpu.join(", "))
+         << QString("\"poll_cpu_seconds\": [%1]").arg(polling.join(", "));
+  QByteArray report = ("{\n  " + fields.join(",\n  ") + "\n}\n").toUtf8();
+
+  if (opt.out.isEmpty()) {
+    std::cout << report.constData();
+  } else {
+    QFile file(opt.out);
+    if (!file.open(QIODevice::WriteOnly) or file.write(report) != report.size()) {
+      std::cerr << "could not write " << opt.out.toStdString() << std::endl;
+      return 1;
+    }
+  }
+
+  for (int n = 0; n < opt.nodes; ++n) {
+    procs.at(n)->terminate();
+    procs.at(n)->waitForFinished(5000);
+    delete(clients.at(n));
+    delete(procs.at(n));
+  }
+  return pending.isEmpty() ? 0 : 1;
+}
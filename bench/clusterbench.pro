@@ -0,0 +1,14 @@
+# local cluster benchmark, build the node first, then with: qmake && make
+# and run ./clusterbench --node ../final (see --help for the mix options)
+
+TEMPLATE = app
+TARGET = clusterbench
+CONFIG += console
+CONFIG -= app_bundle
+DEPENDPATH += .
+INCLUDEPATH += .
+QT += network
+QT -= gui
+
+# Input
+SOURCES += clusterbench.cc
@@ -0,0 +1,121 @@
+#include <iostream>
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QVariantMap>
+
+#include "message.hh"
+
+// Compares the binary wire format against the QDataStream encoded
+// QVariantMap messages nodes used to exchange, for a rumor and for an
+// anti-entropy state of kStateKeys keys.
+
+static const int kRounds = 200000;
+static const int kStateRounds = 200;
+static const int kStateKeys = 1000;
+
+static QByteArray encodeLegacy(const QVariantMap &msg)
+{
+  QByteArray serialized;
+  QDataStream out(&serialized, QIODevice::WriteOnly);
+  out << msg;
+  return serialized;
+}
+
+static QVariantMap decodeLegacy(const QByteArray &datagram)
+{
+  QDataStream in(datagram);
+  QVariantMap msg;
+  in >> msg;
+  return msg;
+}
+
+static void report(const char *name, int bytes, int rounds, qint64 nsecs)
+{
+  std::cout << name << ": " << bytes << " bytes, "
+            << (qint64)(rounds * 1e9 / qMax(nsecs, (qint64)1)) << " encode+decode/s" << std::endl;
+}
+
+static void benchRumor()
+{
+  QVariantMap legacy;
+  legacy.insert(QString("Key"), QString("user:123456"));
+  legacy.insert(QString("Value"), QString("some moderately sized value"));
+  legacy.insert(QString("Version"), 42);
+  legacy.insert(QString("Host"), QString("127.0.0.1"));
+  legacy.insert(QString("Port"), 45000);
+
+  Message msg(kMsgRumor);
+  msg.key = QString("user:123456");
+  msg.value = QString("some moderately sized value");
+  msg.version = 42;
+
+  QElapsedTimer timer;
+  int checksum = 0;
+
+  timer.start();
+  for (int i = 0; i < kRounds; ++i) {
+    checksum += decodeLegacy(encodeLegacy(legacy))[QString("Version")].toInt();
+  }
+  report("rumor   qvariantmap", encodeLegacy(legacy).size(), kRounds, timer.nsecsElapsed());
+
+  timer.start();
+  for (int i = 0; i < kRounds; ++i) {
+    QByteArray datagram = msg.encode();
+    Message out;
+    out.decode(datagram.constData(), datagram.size());
+    checksum += out.version;
+  }
+  report("rumor   binary     ", msg.encode().size(), kRounds, timer.nsecsElapsed());
+
+  if (checksum != 2 * 42 * kRounds) {
+    std::cout << "rumor round trip mismatch" << std::endl;
+  }
+}
+
+static void benchState()
+{
+  QVariantMap legacyState;
+  Message msg(kMsgState);
+  for (int i = 0; i < kStateKeys; ++i) {
+    QString key = QString("user:") + QString::number(i);
+    legacyState.insert(key, i % 50 + 1);
+    msg.state.insert(key, i % 50 + 1);
+  }
+  QVariantMap legacy;
+  legacy.insert(QString("State"), legacyState);
+  legacy.insert(QString("Host"), QString("127.0.0.1"));
+  legacy.insert(QString("Port"), 45000);
+
+  QElapsedTimer timer;
+  int checksum = 0;
+
+  timer.start();
+  for (int i = 0; i < kStateRounds; ++i) {
+    checksum += decodeLegacy(encodeLegacy(legacy))[QString("State")].toMap().size();
+  }
+  report("state   qvariantmap", encodeLegacy(legacy).size(), kStateRounds, timer.nsecsElapsed());
+
+  timer.start();
+  for (int i = 0; i < kStateRounds; ++i) {
+    QByteArray datagram = msg.encode();
+    Message out;
+    out.decode(datagram.constData(), datagram.size());
+    checksum += out.state.size();
+  }
+  report("state   binary     ", msg.encode().size(), kStateRounds, timer.nsecsElapsed());
+
+  if (checksum != 2 * kStateKeys * kStateRounds) {
+    std::cout << "state round trip mismatch" << std::endl;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  QCoreApplication app(argc, argv);
+
+  benchRumor();
+  benchState();
+  return 0;
+}
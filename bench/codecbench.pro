@@ -0,0 +1,14 @@
+# codec microbenchmark, build with: qmake && make && ./codecbench
+
+TEMPLATE = app
+TARGET = codecbench
+CONFIG += console
+CONFIG -= app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+QT += network
+QT -= gui
+
+# Input
+HEADERS += ../message.hh
+SOURCES += codecbench.cc ../message.cc
@@ -0,0 +1,226 @@
+#include <QDataStream>
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QtEndian>
+#include <QDebug>
+
+#include "clientserver.hh"
+
+ClientServer::ClientServer(Node *node)
+{
+  this->node = node;
+  tcpServer = 0;
+  localServer = 0;
+  pendingGets = new QHash<quint32, QPair<QIODevice *, quint32> >();
+  kMaxFrame = 64 * 1024 * 1024; // anything bigger is a broken client
+
+  connect(node, SIGNAL(getFinished(quint32, QString, QString)),
+          this, SLOT(finishGet(quint32, QString, QString)));
+  connect(node, SIGNAL(multiGetFinished(quint32, QStringList, QStringList)),
+          this, SLOT(finishMultiGet(quint32, QStringList, QStringList)));
+}
+
+// listens for clients on a TCP port of the loopback interface
+bool ClientServer::listenTcp(int port)
+{
+  tcpServer = new QTcpServer(this);
+  if (!tcpServer->listen(QHostAddress(QHostAddress::LocalHost), port)) {
+    qWarning() << "could not listen on client port " << port << ": " << tcpServer->errorString();
+    return false;
+  }
+  connect(tcpServer, SIGNAL(newConnection()), this, SLOT(acceptTcpConnection()));
+  qDebug() << "serving clients on TCP port " << port;
+  return true;
+}
+
+// listens for clients on a unix domain socket at path
+bool ClientServer::listenLocal(QString path)
+{
+  localServer = new QLocalServer(this);
+  QLocalServer::removeServer(path); // stale socket left by a crashed node
+  if (!localServer->listen(path)) {
+    qWarning() << "could not listen on client socket " << path << ": " << localServer->errorString();
+    return false;
+  }
+  connect(localServer, SIGNAL(newConnection()), this, SLOT(acceptLocalConnection()));
+  qDebug() << "serving clients on unix socket " << path;
+  return true;
+}
+
+void ClientServer::addConnection(QIODevice *conn)
+{
+  connect(conn, SIGNAL(readyRead()), this, SLOT(readRequests()));
+  connect(conn, SIGNAL(disconnected()), this, SLOT(dropConnection()));
+}
+
+void ClientServer::acceptTcpConnection()
+{
+  while (tcpServer->hasPendingConnections()) {
+    QTcpSocket *conn = tcpServer->nextPendingConnection();
+    conn->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    addConnection(conn);
+  }
+}
+
+void ClientServer::acceptLocalConnection()
+{
+  while (localServer->hasPendingConnections()) {
+    addConnection(localServer->nextPendingConnection());
+  }
+}
+
+// forgets the reads a departed client was waiting on
+void ClientServer::dropConnection()
+{
+  QIODevice *conn = qobject_cast<QIODevice *>(sender());
+  QHash<quint32, QPair<QIODevice *, quint32> >::iterator i = pendingGets->begin();
+  while (i != pendingGets->end()) {
+    if (i.value().first == conn) {
+      i = pendingGets->erase(i);
+    } else {
+      ++i;
+    }
+  }
+  conn->deleteLater();
+}
+
+// parses every complete frame buffered on the connection
+void ClientServer::readRequests()
+{
+  QIODevice *conn = qobject_cast<QIODevice *>(sender());
+  while (conn->bytesAvailable() >= 4) {
+    QByteArray header = conn->peek(4);
+    quint32 size = qFromBigEndian<quint32>((const uchar *)header.constData());
+    if (size > (quint32)kMaxFrame) {
+      qWarning() << "dropping client with oversized frame";
+      conn->close();
+      return;
+    }
+    if (conn->bytesAvailable() < 4 + (qint64)size) {
+      return;
+    }
+    conn->read(4);
+    QByteArray frame = conn->read(size);
+
+    QDataStream in(frame);
+    quint32 id = 0;
+    quint8 op = 0;
+    in >> id >> op;
+    if (op == kClientMultiPut or op == kClientMultiGet) {
+      QStringList keys, values;
+      in >> keys >> values;
+      if (in.status() != QDataStream::Ok) {
+        sendReply(conn, id, kClientError, QString("malformed request"));
+        continue;
+      }
+      handleBatchRequest(conn, id, op, keys, values);
+      continue;
+    }
+
+    QString key, value;
+    in >> key >> value;
+    if (in.status() != QDataStream::Ok) {
+      sendReply(conn, id, kClientError, QString("malformed request"));
+      continue;
+    }
+    handleRequest(conn, id, op, key, value);
+  }
+}
+
+void ClientServer::handleRequest(QIODevice *conn, quint32 id, quint8 op, QString key, QString value)
+{
+  if (op == kClientStats) {
+    sendReply(conn, id, kClientOk, node->statistics());
+    return;
+  }
+  if (key.isEmpty()) {
+    sendReply(conn, id, kClientError, QString("empty key"));
+    return;
+  }
+
+  switch (op) {
+    case kClientPut:
+      node->putRequest(key, value);
+      sendReply(conn, id, kClientOk, QString());
+      break;
+    case kClientGet:
+      // answered from finishGet once the quorum decides
+      pendingGets->insert(node->getRequest(key), qMakePair(conn, id));
+      break;
+    case kClientPeek:
+      sendReply(conn, id, kClientOk, node->peekRequest(key));
+      break;
+    case kClientDelete:
+      if (node->deleteRequest(key)) {
+        sendReply(conn, id, kClientOk, QString());
+      } else {
+        sendReply(conn, id, kClientError, QString("delete failed"));
+      }
+      break;
+    default:
+      sendReply(conn, id, kClientError, QString("unknown op"));
+  }
+}
+
+void ClientServer::handleBatchRequest(QIODevice *conn, quint32 id, quint8 op, QStringList keys, QStringList values)
+{
+  if (keys.contains(QString())) {
+    sendReply(conn, id, kClientError, QString("empty key"));
+    return;
+  }
+
+  if (op == kClientMultiPut) {
+    if (values.size() != keys.size()) {
+      sendReply(conn, id, kClientError, QString("keys and values differ in number"));
+      return;
+    }
+    node->multiPutRequest(keys, values);
+    sendReply(conn, id, kClientOk, QString());
+  } else {
+    // answered from finishMultiGet once every key is decided
+    pendingGets->insert(node->multiGetRequest(keys), qMakePair(conn, id));
+  }
+}
+
+// answers the client waiting on the read, if it is still connected
+void ClientServer::finishGet(quint32 getId, QString key, QString value)
+{
+  Q_UNUSED(key);
+  QHash<quint32, QPair<QIODevice *, quint32> >::iterator i = pendingGets->find(getId);
+  if (i != pendingGets->end()) {
+    sendReply(i.value().first, i.value().second, kClientOk, value);
+    pendingGets->erase(i);
+  }
+}
+
+// answers the client waiting on the batch read, if it is still connected
+void ClientServer::finishMultiGet(quint32 getId, QStringList keys, QStringList values)
+{
+  Q_UNUSED(keys);
+  QHash<quint32, QPair<QIODevice *, quint32> >::iterator i = pendingGets->find(getId);
+  if (i != pendingGets->end()) {
+    sendValues(i.value().first, i.value().second, values);
+    pendingGets->erase(i);
+  }
+}
+
+void ClientServer::sendReply(QIODevice *conn, quint32 id, quint8 status, QString value)
+{
+  QByteArray frame;
+  QDataStream out(&frame, QIODevice::WriteOnly);
+  out << (quint32)0 << id << status << value;
+
+  qToBigEndian<quint32>(frame.size() - 4, (uchar *)frame.data());
+  conn->write(frame);
+}
+
+// the reply to a multi get, always kClientOk
+void ClientServer::sendValues(QIODevice *conn, quint32 id, QStringList values)
+{
+  QByteArray frame;
+  QDataStream out(&frame, QIODevice::WriteOnly);
+  out << (quint32)0 << id << (quint8)kClientOk << values;
+
+  qToBigEndian<quint32>(frame.size() - 4, (uchar *)frame.data());
+  conn->write(frame);
+}
@@ -0,0 +1,69 @@
+#ifndef CLIENTSERVER_CLASS_HH
+#define CLIENTSERVER_CLASS_HH
+
+#include <QTcpServer>
+#include <QLocalServer>
+#include <QHash>
+#include <QPair>
+
+#include "node.hh"
+
+// Request/response protocol spoken by clients over TCP or a unix socket.
+// Every frame is a big endian quint32 length followed by a QDataStream body.
+// requests:  quint32 id, quint8 op, QString key, QString value
+// responses: quint32 id, quint8 status, QString value
+// The batch ops carry a QStringList of keys and one of values instead of
+// key and value, values left empty for a multi get, which is answered with
+// a QStringList of values in the order of the keys.
+// Ids are chosen by the client and echoed back, so a client may keep any
+// number of requests in flight and match the answers as they arrive.
+enum ClientOp
+{
+  kClientPut = 1,
+  kClientGet = 2,
+  kClientDelete = 3,
+  kClientMultiPut = 4,
+  kClientMultiGet = 5,
+  kClientPeek = 6,   // the value this node holds, without a quorum
+  kClientStats = 7   // counters of the node as "name value" lines, key ignored
+};
+
+enum ClientStatus
+{
+  kClientOk = 0,
+  kClientError = 1,
+  kClientUnsupported = 2
+};
+
+class ClientServer : public QObject
+{
+  Q_OBJECT
+
+  public:
+    ClientServer(Node *node);
+    bool listenTcp(int port);
+    bool listenLocal(QString path);
+
+  public slots:
+    void acceptTcpConnection();
+    void acceptLocalConnection();
+    void readRequests();
+    void dropConnection();
+    void finishGet(quint32 getId, QString key, QString value);
+    void finishMultiGet(quint32 getId, QStringList keys, QStringList values);
+
+  private:
+    void addConnection(QIODevice *conn);
+    void handleRequest(QIODevice *conn, quint32 id, quint8 op, QString key, QString value);
+    void handleBatchRequest(QIODevice *conn, quint32 id, quint8 op, QStringList keys, QStringList values);
+    void sendReply(QIODevice *conn, quint32 id, quint8 status, QString value);
+    void sendValues(QIODevice *conn, quint32 id, QStringList values);
+
+    Node *node;
+    QTcpServer *tcpServer;
+    QLocalServer *localServer;
+    QHash<quint32, QPair<QIODevice *, quint32> > *pendingGets; // node read id to waiting <connection, id>, batch reads included
+    int kMaxFrame;
+};
+
+#endif
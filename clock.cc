@@ -0,0 +1,32 @@
+#include <QTimer>
+
+#include "clock.hh"
+
+// the one wall clock of the process, for everything not given another clock
+Clock *Clock::wall()
+{
+  static WallClock clock;
+  return &clock;
+}
+
+WallClock::WallClock()
+{
+  clock.start();
+}
+
+qint64 WallClock::now() const
+{
+  return clock.elapsed();
+}
+
+void WallClock::every(int interval, QObject *target, const char *member)
+{
+  QTimer *timer = new QTimer(target);
+  QObject::connect(timer, SIGNAL(timeout()), target, member);
+  timer->start(interval);
+}
+
+void WallClock::after(int delay, QObject *target, const char *member)
+{
+  QTimer::singleShot(delay, target, member);
+}
@@ -0,0 +1,37 @@
+#ifndef CLOCK_CLASS_HH
+#define CLOCK_CLASS_HH
+
+#include <QElapsedTimer>
+#include <QObject>
+
+// Time and timers of the protocol components. A node runs them on the wall
+// clock, the simulator on a virtual clock it advances itself, so the same
+// rumor, quorum and tombstone code runs faster than real time there.
+// Members are given with SLOT() or SIGNAL() like to QObject::connect.
+class Clock
+{
+  public:
+    virtual ~Clock() {}
+    virtual qint64 now() const = 0; // ms since the clock started
+    // invokes member of target every interval ms, for as long as target lives
+    virtual void every(int interval, QObject *target, const char *member) = 0;
+    // invokes member of target once, delay ms from now
+    virtual void after(int delay, QObject *target, const char *member) = 0;
+
+    static Clock *wall();
+};
+
+// real time, timers are QTimers owned by their target
+class WallClock : public Clock
+{
+  public:
+    WallClock();
+    qint64 now() const;
+    void every(int interval, QObject *target, const char *member);
+    void after(int delay, QObject *target, const char *member);
+
+  private:
+    QElapsedTimer clock;
+};
+
+#endif
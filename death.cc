@@ -1,32 +1,60 @@
-#include <unistd.h>
-
 #include "death.hh"
 
-void HotRumor::checkAcks()
+Death::Death(Clock *clock)
 {
-  QVariantMap t;
-  ackmsg = t;
+  this->clock = clock;
+  kTimeout = 10000;
+  kExpiration = 60000;
+  kDeletion = 3600000;
+  clock->every(kTimeout, this, SIGNAL(sweep()));
 }
 
-Death::Death(QString key)
+// records that key was deleted as version, seq being the change that recorded it
+void Death::bury(const QString &key, int version, quint64 seq)
 {
-  kTimeout = 2000;
-  kRumorProb = 2;
-  kExpiration = 60000;
-  kDeletion = 120000;
-  key = key;
+  Tombstone t;
+  t.version = version;
+  t.seq = seq;
+  t.since = clock->now();
+  tombstones.insert(key, t);
+}
+
+// forgets the tombstone of key, it was written again or collected
+void Death::revive(const QString &key)
+{
+  tombstones.remove(key);
+}
+
+bool Death::isDead(const QString &key) const
+{
+  return tombstones.contains(key);
+}
 
-  timer = new QTimer(this);
-  connect(timer, SIGNAL(timeout()), this, SLOT(checkAcks()));
-  timer->start(kTimeout);
+Tombstone Death::tombstone(const QString &key) const
+{
+  return tombstones.value(key);
+}
 
-  QVariantMap t;
-  ackmsg = t;
+// whether the tombstone is old enough to be collected without waiting for acks
+bool Death::overdue(const Tombstone &tombstone) const
+{
+  return clock->now() - tombstone.since >= kDeletion;
 }
 
-Death::~Death()
+// keys whose tombstones are old enough to be collected once the replicas have them
+QStringList Death::expired() const
 {
-  if (timer) {
-    delete(timer);
+  QStringList out;
+  qint64 now = clock->now();
+  for (QHash<QString, Tombstone>::const_iterator i = tombstones.begin(); i != tombstones.end(); ++i) {
+    if (now - i.value().since >= kExpiration) {
+      out.append(i.key());
+    }
   }
+  return out;
+}
+
+int Death::size() const
+{
+  return tombstones.size();
 }
@@ -1,25 +1,50 @@
 #ifndef DEATH_CLASS_HH
 #define DEATH_CLASS_HH
 
-#include <QVariantMap>
-#include <QTimer>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
 
+#include "clock.hh"
+
+// a deleted key, kept until every replica of the key has it
+struct Tombstone
+{
+  Tombstone() : version(0), seq(0), since(0) {}
+
+  int version;
+  quint64 seq;  // change of the version table that recorded it
+  qint64 since; // ms it was recorded at
+};
+
+// Tombstones of the keys deleted here or learned from other nodes.
+// A tombstone has to outlive the values it deletes everywhere, or
+// anti-entropy brings them back, so it expires kExpiration ms after it was
+// recorded and the node collects it once every replica of its key has also
+// acked a delta covering it. Past kDeletion ms it is collected regardless,
+// so a replica that never answers again can't keep tombstones around
+// forever. Every kTimeout ms sweep() asks the node to collect.
 class Death : public QObject
 {
   Q_OBJECT
-  public:
-    Death();
-    ~Death();
 
-    QTimer *timer;
-    QString key;
-    QVariantMap ackmsg;
+  public:
+    Death(Clock *clock = Clock::wall());
+    void bury(const QString &key, int version, quint64 seq);
+    void revive(const QString &key);
+    bool isDead(const QString &key) const;
+    Tombstone tombstone(const QString &key) const;
+    bool overdue(const Tombstone &tombstone) const;
+    QStringList expired() const;
+    int size() const;
 
-  public slots:
-    void checkAcks();
+  signals:
+    void sweep();
 
   private:
-    int kTimeout, kRumorProb, kExpiration, kDeletion;
-}
+    QHash<QString, Tombstone> tombstones;
+    Clock *clock;
+    int kTimeout, kExpiration, kDeletion;
+};
 
 #endif
@@ -7,7 +7,8 @@ TARGET =
 DEPENDPATH += .
 INCLUDEPATH += .
 QT += network
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 # Input
-HEADERS += main.hh netsocket.hh hotrumor.hh quorum.hh
-SOURCES += main.cc netsocket.cc hotrumor.cc quorum.cc
+HEADERS += main.hh node.hh clientserver.hh netsocket.hh streamer.hh membership.hh message.hh merkle.hh ring.hh versiontable.hh versiontracker.hh valuecache.hh storage.hh transport.hh logstore.hh asyncstore.hh mpscqueue.hh receiver.hh timerwheel.hh hotrumor.hh gossip.hh death.hh quorum.hh clock.hh metrics.hh tracer.hh lease.hh
+SOURCES += main.cc node.cc clientserver.cc netsocket.cc streamer.cc membership.cc message.cc merkle.cc ring.cc versiontable.cc versiontracker.cc valuecache.cc logstore.cc asyncstore.cc receiver.cc timerwheel.cc hotrumor.cc gossip.cc death.cc quorum.cc clock.cc metrics.cc tracer.cc lease.cc
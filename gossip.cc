@@ -0,0 +1,103 @@
+#include <QtGlobal>
+
+#include "gossip.hh"
+#include "message.hh"
+#include "metrics.hh"
+
+GossipController::GossipController()
+{
+  freshAcks = 0;
+  duplicateAcks = 0;
+  divergentKeys = 0;
+  duplicateRatio = 0.5;
+
+  kMaxFanout = 3;
+  kMinRumorInterval = 250;
+  kMaxRumorInterval = 2000;
+  kMinAntiEntropy = 2000;
+  kMaxAntiEntropy = 60000;
+  kSmoothing = 0.3; // weight of the newest window
+
+  // what used to be the fixed settings
+  currentFanout = 1;
+  currentRumorInterval = 2000;
+  currentStopOdds = 2;
+  currentAntiEntropy = 15000;
+}
+
+// holds the settings given in fixed at their value from now on, a
+// simulation compares settings this way
+void GossipController::fix(const FixedGossip &settings)
+{
+  fixed = settings;
+}
+
+// counts the ack of a rumor, kAckFresh if the peer did not know it yet
+void GossipController::ackSeen(int ack)
+{
+  if (ack == kAckFresh) {
+    ++freshAcks;
+  } else {
+    ++duplicateAcks;
+  }
+}
+
+// counts keys an anti-entropy exchange found out of sync
+void GossipController::divergence(int keys)
+{
+  divergentKeys += keys;
+}
+
+// recomputes the settings from what was seen since the last update
+void GossipController::update(bool congested)
+{
+  int acks = freshAcks + duplicateAcks;
+  if (acks > 0) {
+    duplicateRatio += kSmoothing * ((double)duplicateAcks / acks - duplicateRatio);
+  }
+
+  if (congested) {
+    currentFanout = 1;
+    currentRumorInterval = kMaxRumorInterval;
+    currentStopOdds = 1;
+  } else {
+    double spreading = 1 - duplicateRatio;
+    currentFanout = 1 + qRound(spreading * (kMaxFanout - 1));
+    currentRumorInterval = kMinRumorInterval + qRound(duplicateRatio * (kMaxRumorInterval - kMinRumorInterval));
+    currentStopOdds = spreading > 0.5 ? 3 : (spreading > 0.2 ? 2 : 1);
+  }
+
+  freshAcks = 0;
+  duplicateAcks = 0;
+}
+
+// ms until the next anti-entropy round, halved after a round that found
+// divergent keys and grown by a quarter after one that found none
+int GossipController::nextAntiEntropy(bool congested)
+{
+  if (congested) {
+    currentAntiEntropy = kMaxAntiEntropy;
+  } else if (divergentKeys > 0) {
+    currentAntiEntropy = qMax(kMinAntiEntropy, currentAntiEntropy / 2);
+  } else {
+    currentAntiEntropy = qMin(kMaxAntiEntropy, currentAntiEntropy * 5 / 4);
+  }
+  Metrics::global()->divergence.record(divergentKeys);
+  divergentKeys = 0;
+  return fixed.antiEntropy ? fixed.antiEntropy : currentAntiEntropy;
+}
+
+int GossipController::fanout() const
+{
+  return fixed.fanout ? fixed.fanout : currentFanout;
+}
+
+int GossipController::rumorInterval() const
+{
+  return fixed.rumorInterval ? fixed.rumorInterval : currentRumorInterval;
+}
+
+int GossipController::stopOdds() const
+{
+  return fixed.stopOdds ? fixed.stopOdds : currentStopOdds;
+}
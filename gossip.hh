@@ -0,0 +1,47 @@
+#ifndef GOSSIP_CLASS_HH
+#define GOSSIP_CLASS_HH
+
+// gossip settings held fixed instead of tuned, 0 leaves one to the controller
+struct FixedGossip
+{
+  FixedGossip() : stopOdds(0), fanout(0), rumorInterval(0), antiEntropy(0) {}
+
+  int stopOdds;
+  int fanout;
+  int rumorInterval;
+  int antiEntropy;
+};
+
+// Picks the gossip parameters of a node from what gossip observes.
+// While most acks of hot rumors are fresh an update is still spreading, so
+// rumors go out more often, to more replicas, and survive more duplicate
+// acks; once acks are mostly duplicates the cluster has it and rumors slow
+// down and die quickly. Anti-entropy runs more often while its rounds keep
+// finding divergent keys and backs off while they find none. A backed up
+// send queue overrides both with the quietest settings.
+class GossipController
+{
+  public:
+    GossipController();
+    void fix(const FixedGossip &settings);
+    void ackSeen(int ack);
+    void divergence(int keys);
+    void update(bool congested);
+    int nextAntiEntropy(bool congested);
+
+    int fanout() const;           // replicas each hot rumor is sent to per interval
+    int rumorInterval() const;    // ms between sends of a hot rumor
+    int stopOdds() const;         // a duplicate ack stops a rumor with probability 1 / stopOdds
+
+  private:
+    int freshAcks, duplicateAcks; // since the last update
+    int divergentKeys;            // since the last anti-entropy round
+    double duplicateRatio;        // smoothed over updates
+    FixedGossip fixed;
+
+    int currentFanout, currentRumorInterval, currentStopOdds, currentAntiEntropy;
+    int kMaxFanout, kMinRumorInterval, kMaxRumorInterval, kMinAntiEntropy, kMaxAntiEntropy;
+    double kSmoothing;
+};
+
+#endif
@@ -1,46 +1,106 @@
 #include <unistd.h>
+#include <stdlib.h>
 
 #include "hotrumor.hh"
+#include "metrics.hh"
 
-void HotRumor::checkAcks()
-{
-  // if we don't receive an ack at all, or if the node responded positively, we keep sending out messages
-  if ((ackmsg.contains(QString("Ack")) and ackmsg.contains(QString("Key")) and
-      ackmsg.contains(QString("Version")) and ackmsg[QString("Ack")] == 1 and
-      ackmsg[QString("Key")] == key and ackmsg[QString("Version")] == version) or
-      not ackmsg.contains(QString("Ack"))) {
-    emit sendRandomMessage(msg);
-  } else {
-    if (rand() % kRumorProb == 0) {
-      emit eliminateRumor(key);
-    } else {
-      emit sendRandomMessage(msg);
+RumorTable::RumorTable(Clock *clock)
+{
+  timeout = 2000;
+  stopOdds = 2;
+  nextId = 0;
+  deferred = false;
+
+  // 100 ms ticks, a 2000 ms timeout is 20 slots away
+  wheel = new TimerWheel(64, 100);
+  clock->every(wheel->tick(), this, SLOT(tick()));
+}
+
+RumorTable::~RumorTable()
+{
+  delete(wheel);
+}
+
+// starts spreading msg, replacing any older rumor of the same key
+void RumorTable::add(const Message &msg)
+{
+  HotRumor rumor;
+  rumor.key = msg.key;
+  rumor.version = msg.version;
+  rumor.ack = -1;
+  rumor.id = nextId++;
+  rumor.msg = msg;
+  rumors.insert(rumor.key, rumor);
+  Metrics::global()->rumorsCreated.add();
+  wheel->schedule(rumor.key, rumor.id, timeout);
+}
+
+// stops spreading the rumor of key if there is one
+void RumorTable::remove(QString key)
+{
+  rumors.remove(key);
+}
+
+// attaches ack message to proper rumor
+void RumorTable::attachAck(const Message &ackmsg)
+{
+  QHash<QString, HotRumor>::iterator i = rumors.find(ackmsg.key);
+  if (i != rumors.end() and i.value().version == ackmsg.version) {
+    Metrics::global()->rumorsAcked.add();
+    if (ackmsg.version == 0) {
+      // a forwarded put is done once the primary took it
+      rumors.erase(i);
+      return;
     }
+    i.value().ack = ackmsg.ack;
   }
+}
+
+void RumorTable::setDeferred(bool deferred)
+{
+  this->deferred = deferred;
+}
 
-  // wipe ackmsg
-  QVariantMap t;
-  ackmsg = t;
+void RumorTable::tune(int timeout, int stopOdds)
+{
+  this->timeout = timeout;
+  this->stopOdds = stopOdds;
 }
 
-HotRumor::HotRumor(QVariantMap inmsg)
+int RumorTable::size() const
 {
-  kTimeout = 2000;
-  kRumorProb = 2;
-  key = inmsg[QString("Key")].toString();
-  version = inmsg[QString("Version")].toInt();
-  timer = new QTimer(this);
-  connect(timer, SIGNAL(timeout()), this, SLOT(checkAcks()));
-  timer->start(kTimeout);
-  
-  QVariantMap t;
-  ackmsg = t;
-  msg = inmsg;
+  return rumors.size();
 }
 
-HotRumor::~HotRumor()
+// checks the acks of every rumor whose timeout expired on this tick
+void RumorTable::tick()
 {
-  if (timer) {
-    delete(timer);
+  QList<QPair<QString, quint64> > due = wheel->advance();
+  for (int i = 0; i < due.size(); ++i) {
+    QHash<QString, HotRumor>::iterator r = rumors.find(due.at(i).first);
+    if (r == rumors.end() or r.value().id != due.at(i).second) {
+      // eliminated or replaced by a newer version since it was scheduled
+      continue;
+    }
+
+    HotRumor &rumor = r.value();
+    if (deferred) {
+      wheel->schedule(rumor.key, rumor.id, timeout);
+      continue;
+    }
+
+    // if we don't receive an ack at all, or if the node responded positively, we keep sending out messages
+    if (rumor.ack == kAckKnown and rand() % stopOdds == 0) {
+      Metrics::global()->rumorsEliminated.add();
+      if (rumor.msg.trace.id) {
+        emit stopped(rumor.msg);
+      }
+      rumors.erase(r);
+      continue;
+    }
+
+    emit sendRandomMessage(rumor.msg);
+    rumor.ack = -1;
+    wheel->schedule(rumor.key, rumor.id, timeout);
   }
 }
@@ -1,32 +1,57 @@
 #ifndef HOTRUMOR_CLASS_HH
 #define HOTRUMOR_CLASS_HH
 
-#include <QVariantMap>
-#include <QTimer>
+#include <QHash>
+#include <QObject>
 
-class HotRumor : public QObject
+#include "clock.hh"
+#include "message.hh"
+#include "timerwheel.hh"
+
+// a rumor this node is still spreading
+struct HotRumor
+{
+  QString key;
+  int version;
+  int ack;     // last ack received for this version, -1 if none since the last tick
+  quint64 id;  // tells a rumor from an earlier one of the same key in the wheel
+  Message msg;
+};
+
+// All hot rumors of a node, indexed by key, driven by one timer wheel.
+// Every timeout ms each rumor is sent to a random neighbor again, until a
+// neighbor that already knew it makes it stop with probability 1/stopOdds.
+// Both are tuned at runtime by the node's GossipController. A put this
+// node forwarded to the key's primary is a rumor of version 0, it is sent
+// again every timeout ms until the primary acks it.
+// While the socket reports congestion the resends are pushed back instead.
+class RumorTable : public QObject
 {
   Q_OBJECT
 
   public:
-    HotRumor(QVariantMap);
-    ~HotRumor();
-    QTimer *timer;
-
-    QString key;
-    int version;
-    QVariantMap ackmsg;
+    RumorTable(Clock *clock = Clock::wall());
+    ~RumorTable();
+    void add(const Message &msg);
+    void remove(QString key);
+    void attachAck(const Message &ackmsg);
+    int size() const;
+    void tune(int timeout, int stopOdds);
 
   public slots:
-    void checkAcks();
+    void tick();
+    void setDeferred(bool deferred);
 
   signals:
-    void eliminateRumor(QString);
-    void sendRandomMessage(QVariantMap);
+    void sendRandomMessage(Message);
+    void stopped(Message); // a traced rumor was eliminated
 
   private:
-    int kTimeout, kRumorProb;
-    QVariantMap msg;
+    QHash<QString, HotRumor> rumors;
+    TimerWheel *wheel;
+    quint64 nextId;
+    bool deferred; // the network is backed up, resends wait a round
+    int timeout, stopOdds;
 };
 
 #endif
@@ -0,0 +1,50 @@
+#include "lease.hh"
+
+LeaseTable::LeaseTable(int window, Clock *clock)
+{
+  this->clock = clock;
+  this->window = window;
+  kSweepInterval = 10000;
+  if (window > 0) {
+    clock->every(qMax(window, kSweepInterval), this, SLOT(sweep()));
+  }
+}
+
+// key was seen fresh here by a read that began at since
+void LeaseTable::grant(const QString &key, qint64 since)
+{
+  if (window <= 0 or since + window <= clock->now()) {
+    return;
+  }
+  qint64 &until = expiry[key];
+  until = qMax(until, since + window);
+}
+
+bool LeaseTable::holds(const QString &key) const
+{
+  QHash<QString, qint64>::const_iterator i = expiry.constFind(key);
+  return i != expiry.constEnd() and clock->now() < i.value();
+}
+
+void LeaseTable::clear()
+{
+  expiry.clear();
+}
+
+int LeaseTable::size() const
+{
+  return expiry.size();
+}
+
+// forgets the leases that ran out
+void LeaseTable::sweep()
+{
+  qint64 now = clock->now();
+  for (QHash<QString, qint64>::iterator i = expiry.begin(); i != expiry.end(); ) {
+    if (now >= i.value()) {
+      i = expiry.erase(i);
+    } else {
+      ++i;
+    }
+  }
+}
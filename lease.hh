@@ -0,0 +1,36 @@
+#ifndef LEASE_CLASS_HH
+#define LEASE_CLASS_HH
+
+#include <QHash>
+#include <QObject>
+
+#include "clock.hh"
+
+// Keys this node may answer reads of from its own state, without a quorum.
+// A read that heard from every replica of a key and left this node holding
+// the newest version grants a lease on the key until window ms after the
+// read began, so a local read returns a version that was the newest at
+// most window ms ago. Membership changes move keys between replicas and
+// drop every lease. A window of 0 grants none.
+class LeaseTable : public QObject
+{
+  Q_OBJECT
+
+  public:
+    LeaseTable(int window, Clock *clock = Clock::wall());
+    void grant(const QString &key, qint64 since);
+    bool holds(const QString &key) const;
+    void clear();
+    int size() const;
+
+  public slots:
+    void sweep();
+
+  private:
+    QHash<QString, qint64> expiry; // ms on clock when the lease of a key runs out
+    Clock *clock;
+    int window;
+    int kSweepInterval;
+};
+
+#endif
@@ -0,0 +1,695 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <QDir>
+#include <QStringList>
+#include <QtEndian>
+#include <QVector>
+#include <QDebug>
+
+#include "logstore.hh"
+#include "metrics.hh"
+
+static const int kHeaderSize = 16;
+static const quint32 kCheckpointMagic = 0x58494c47; // "GLIX"
+static const int kCheckpointHeader = 16;
+static const int kCheckpointSegment = 20; // number, size, dead
+static const int kCheckpointKey = 24;     // version, segment, offset, size, key length
+static const quint32 kTombstoneBit = 0x80000000; // in the version of records and checkpointed keys
+
+// standard crc32 (ieee 802.3), table built on first use
+static quint32 crc32(const uchar *p, qint64 len)
+{
+  static quint32 table[256];
+  static bool built = false;
+  if (!built) {
+    for (quint32 i = 0; i < 256; ++i) {
+      quint32 c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    built = true;
+  }
+
+  quint32 crc = 0xffffffff;
+  for (qint64 i = 0; i < len; ++i) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+// reads exactly len bytes at offset, returns false on a short read
+static bool readAt(int fd, char *buf, qint64 len, qint64 offset)
+{
+  while (len > 0) {
+    ssize_t n = pread(fd, buf, len, offset);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static bool writeAt(int fd, const char *buf, qint64 len, qint64 offset)
+{
+  while (len > 0) {
+    ssize_t n = pwrite(fd, buf, len, offset);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+LogStore::LogStore()
+{
+  active = -1;
+  victim = -1;
+  victimPos = 0;
+  kSegmentSize = 64 * 1024 * 1024;
+  kCompactInterval = 1000;
+  kCompactBatch = 1000;
+  kCompactRatio = 0.5; // compact a segment once half of it is overwritten
+  kCheckpointBytes = 16 * 1024 * 1024;
+  kCheckpointTicks = 30;
+  kCacheBytes = 64 * 1024 * 1024;
+  cache = new ValueCache(kCacheBytes);
+  uncheckpointed = 0;
+  idleTicks = 0;
+
+  compactTimer = new QTimer(this);
+  connect(compactTimer, SIGNAL(timeout()), this, SLOT(compact()));
+}
+
+LogStore::~LogStore()
+{
+  if (uncheckpointed > 0) {
+    writeCheckpoint();
+  }
+  for (QMap<int, LogSegment>::const_iterator i = segments.begin(); i != segments.end(); ++i) {
+    close(i.value().fd);
+  }
+  delete(cache);
+}
+
+QString LogStore::segmentPath(int segment)
+{
+  return dir + "/" + QString::number(segment).rightJustified(8, QChar('0')) + ".log";
+}
+
+bool LogStore::openSegment(int segment, bool create)
+{
+  int fd = ::open(segmentPath(segment).toLocal8Bit().constData(),
+                  O_RDWR | (create ? O_CREAT : 0), S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    qWarning() << "could not open segment " << segmentPath(segment) << ": " << strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  LogSegment seg;
+  seg.fd = fd;
+  seg.size = st.st_size;
+  seg.dead = 0;
+  QWriteLocker locker(&indexLock);
+  segments.insert(segment, seg);
+  return true;
+}
+
+// replays the records of a segment from offset from on into the index,
+// cutting off a torn tail
+bool LogStore::recoverSegment(int segment, qint64 from)
+{
+  LogSegment &seg = segments[segment];
+  QByteArray data(seg.size - from, 0);
+  if (!readAt(seg.fd, data.data(), data.size(), from)) {
+    return false;
+  }
+
+  const uchar *base = (const uchar *)data.constData();
+  qint64 pos = from;
+  while (pos + kHeaderSize <= seg.size) {
+    const uchar *p = base + (pos - from);
+    quint32 keyLen = qFromLittleEndian<quint32>(p + 4);
+    quint32 valueLen = qFromLittleEndian<quint32>(p + 8);
+    qint64 size = kHeaderSize + (qint64)keyLen + valueLen;
+    if (size > seg.size - pos or
+        qFromLittleEndian<quint32>(p) != crc32(p + 4, size - 4)) {
+      break;
+    }
+
+    LogLocation loc;
+    loc.segment = segment;
+    loc.offset = pos;
+    loc.size = size;
+    quint32 version = qFromLittleEndian<quint32>(p + 12);
+    loc.version = version & ~kTombstoneBit;
+    loc.deleted = version & kTombstoneBit;
+    place(QString::fromUtf8((const char *)p + kHeaderSize, keyLen), loc);
+    pos += size;
+  }
+
+  if (pos < seg.size) {
+    // a write that never finished or a damaged record, nothing after it can be trusted
+    qWarning() << "truncating segment " << segment << " at " << pos << " of " << seg.size;
+    if (ftruncate(seg.fd, pos) != 0) {
+      return false;
+    }
+    seg.size = pos;
+  }
+  return true;
+}
+
+QString LogStore::checkpointPath()
+{
+  return dir + "/index.ckp";
+}
+
+// Loads the index from the checkpoint if it matches the segments on disk,
+// and tells from which segment and offset on the log still has to be
+// replayed. Keys of segments compacted away since are dropped, compaction
+// copied them past the checkpoint so the replay brings them back.
+bool LogStore::loadCheckpoint(int &segment, qint64 &offset)
+{
+  int fd = ::open(checkpointPath().toLocal8Bit().constData(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < kCheckpointHeader) {
+    close(fd);
+    return false;
+  }
+  qint64 size = st.st_size;
+  void *map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  const uchar *base = (const uchar *)map;
+  const uchar *end = base + size;
+  bool ok = qFromLittleEndian<quint32>(base) == kCheckpointMagic and
+            qFromLittleEndian<quint32>(base + 4) == crc32(base + 8, size - 8);
+  quint32 segmentCount = qFromLittleEndian<quint32>(base + 8);
+  quint32 keyCount = qFromLittleEndian<quint32>(base + 12);
+  const uchar *p = base + kCheckpointHeader;
+  ok = ok and segmentCount > 0 and segmentCount <= (quint32)(end - p) / kCheckpointSegment;
+
+  // every sealed segment must be as it was, the active one may have grown
+  QMap<int, qint64> dead;
+  for (quint32 i = 0; i < segmentCount and ok; ++i, p += kCheckpointSegment) {
+    int number = qFromLittleEndian<quint32>(p);
+    qint64 covered = qFromLittleEndian<qint64>(p + 4);
+    QMap<int, LogSegment>::const_iterator s = segments.constFind(number);
+    bool last = i + 1 == segmentCount;
+    if (s == segments.constEnd()) {
+      ok = !last;
+    } else {
+      ok = last ? s.value().size >= covered : s.value().size == covered;
+      dead.insert(number, qFromLittleEndian<qint64>(p + 12));
+    }
+    segment = number;
+    offset = covered;
+  }
+  // and nothing older may have appeared that it does not know about
+  ok = ok and (segments.isEmpty() or segments.lastKey() >= segment);
+  for (QMap<int, LogSegment>::const_iterator s = segments.begin(); ok and s != segments.end(); ++s) {
+    ok = s.key() >= segment or dead.contains(s.key());
+  }
+
+  for (quint32 i = 0; i < keyCount and ok; ++i) {
+    if (end - p < kCheckpointKey) {
+      ok = false;
+      break;
+    }
+    LogLocation loc;
+    quint32 version = qFromLittleEndian<quint32>(p);
+    loc.version = version & ~kTombstoneBit;
+    loc.deleted = version & kTombstoneBit;
+    loc.segment = qFromLittleEndian<quint32>(p + 4);
+    loc.offset = qFromLittleEndian<qint64>(p + 8);
+    loc.size = qFromLittleEndian<quint32>(p + 16);
+    quint32 keyLen = qFromLittleEndian<quint32>(p + 20);
+    p += kCheckpointKey;
+    if ((quint64)keyLen > (quint64)(end - p)) {
+      ok = false;
+      break;
+    }
+    if (segments.contains(loc.segment)) {
+      index.insert(QString::fromUtf8((const char *)p, keyLen), loc);
+    }
+    p += keyLen;
+  }
+  munmap(map, size);
+
+  if (!ok) {
+    qWarning() << "ignoring checkpoint of " << dir << ", replaying the whole log";
+    index.clear();
+    return false;
+  }
+  for (QMap<int, qint64>::const_iterator d = dead.begin(); d != dead.end(); ++d) {
+    segments[d.key()].dead = d.value();
+  }
+  return true;
+}
+
+// writes the index next to the log, replacing the previous checkpoint
+// only once the new one is on disk, the caller holds mutex
+bool LogStore::writeCheckpoint()
+{
+  // the checkpoint must never cover records that could still be lost
+  fsync(segments[active].fd);
+
+  // readers may go on while the index is copied, only the file writes wait
+  QReadLocker locker(&indexLock);
+  QByteArray out(kCheckpointHeader, 0);
+  out.reserve(kCheckpointHeader + segments.size() * kCheckpointSegment + index.size() * (kCheckpointKey + 16));
+  uchar buf[kCheckpointKey];
+  for (QMap<int, LogSegment>::const_iterator s = segments.begin(); s != segments.end(); ++s) {
+    qToLittleEndian<quint32>(s.key(), buf);
+    qToLittleEndian<qint64>(s.value().size, buf + 4);
+    qToLittleEndian<qint64>(s.value().dead, buf + 12);
+    out.append((const char *)buf, kCheckpointSegment);
+  }
+  for (QHash<QString, LogLocation>::const_iterator i = index.begin(); i != index.end(); ++i) {
+    QByteArray k = i.key().toUtf8();
+    qToLittleEndian<quint32>(i.value().version | (i.value().deleted ? kTombstoneBit : 0), buf);
+    qToLittleEndian<quint32>(i.value().segment, buf + 4);
+    qToLittleEndian<qint64>(i.value().offset, buf + 8);
+    qToLittleEndian<quint32>(i.value().size, buf + 16);
+    qToLittleEndian<quint32>(k.size(), buf + 20);
+    out.append((const char *)buf, kCheckpointKey);
+    out.append(k);
+  }
+
+  uchar *p = (uchar *)out.data();
+  qToLittleEndian<quint32>(kCheckpointMagic, p);
+  qToLittleEndian<quint32>(segments.size(), p + 8);
+  qToLittleEndian<quint32>(index.size(), p + 12);
+  qToLittleEndian<quint32>(crc32(p + 8, out.size() - 8), p + 4);
+  locker.unlock();
+
+  QString tmp = checkpointPath() + ".tmp";
+  int fd = ::open(tmp.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0 or !writeAt(fd, out.constData(), out.size(), 0) or fsync(fd) != 0) {
+    qWarning() << "failed to write checkpoint of " << dir << ": " << strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  close(fd);
+  if (rename(tmp.toLocal8Bit().constData(), checkpointPath().toLocal8Bit().constData()) != 0) {
+    return false;
+  }
+  int dirFd = ::open(dir.toLocal8Bit().constData(), O_RDONLY);
+  if (dirFd >= 0) {
+    fsync(dirFd);
+    close(dirFd);
+  }
+
+  uncheckpointed = 0;
+  idleTicks = 0;
+  return true;
+}
+
+// opens the log in dir and rebuilds the index from the checkpoint and the
+// segments written after it
+bool LogStore::open(QString dir)
+{
+  this->dir = dir;
+
+  QStringList names = QDir(dir).entryList(QStringList() << "*.log", QDir::Files, QDir::Name);
+  for (int i = 0; i < names.size(); ++i) {
+    bool ok;
+    int segment = names.at(i).left(names.at(i).size() - 4).toInt(&ok);
+    if (!ok) {
+      continue;
+    }
+    if (!openSegment(segment, false)) {
+      return false;
+    }
+    active = segment;
+  }
+
+  int from = segments.isEmpty() ? 0 : segments.firstKey();
+  qint64 offset = 0;
+  if (!loadCheckpoint(from, offset)) {
+    from = segments.isEmpty() ? 0 : segments.firstKey();
+    offset = 0;
+  }
+  for (QMap<int, LogSegment>::const_iterator s = segments.begin(); s != segments.end(); ++s) {
+    if (s.key() >= from and !recoverSegment(s.key(), s.key() == from ? offset : 0)) {
+      return false;
+    }
+  }
+
+  if (active < 0) {
+    active = 0;
+    if (!openSegment(active, true)) {
+      return false;
+    }
+  }
+
+  qDebug() << "recovered " << index.size() << " keys from " << segments.size() << " segments";
+  compactTimer->start(kCompactInterval);
+  return true;
+}
+
+// appends a record to the active segment, rolling over to a new one when full
+bool LogStore::append(const QByteArray &record, LogLocation &loc)
+{
+  if (segments[active].size > 0 and segments[active].size + record.size() > kSegmentSize) {
+    fsync(segments[active].fd);
+    if (!openSegment(active + 1, true)) {
+      return false;
+    }
+    active = active + 1;
+  }
+
+  LogSegment &seg = segments[active];
+  if (!writeAt(seg.fd, record.constData(), record.size(), seg.size)) {
+    qWarning() << "failed to append to segment " << active << ": " << strerror(errno);
+    // drop whatever part of the record made it so the log stays parseable
+    if (ftruncate(seg.fd, seg.size) != 0) {
+      qWarning() << "failed to truncate segment " << active;
+    }
+    return false;
+  }
+
+  loc.segment = active;
+  loc.offset = seg.size;
+  loc.size = record.size();
+  seg.size += record.size();
+  uncheckpointed += record.size();
+  return true;
+}
+
+// accounts a record as overwritten
+void LogStore::retire(const LogLocation &loc)
+{
+  QMap<int, LogSegment>::iterator seg = segments.find(loc.segment);
+  if (seg != segments.end()) {
+    seg.value().dead += loc.size;
+  }
+}
+
+// appends the record of a key/value pair, or of a tombstone of key, to out,
+// returns its size
+static int appendRecord(QByteArray &out, const QString &key, int version, bool deleted,
+                        const QString &value)
+{
+  QByteArray k = key.toUtf8();
+  QByteArray v = value.toUtf8();
+
+  int start = out.size();
+  int size = kHeaderSize + k.size() + v.size();
+  out.resize(start + size);
+  uchar *p = (uchar *)out.data() + start;
+  qToLittleEndian<quint32>(k.size(), p + 4);
+  qToLittleEndian<quint32>(v.size(), p + 8);
+  qToLittleEndian<quint32>(version | (deleted ? kTombstoneBit : 0), p + 12);
+  memcpy(p + kHeaderSize, k.constData(), k.size());
+  memcpy(p + kHeaderSize + k.size(), v.constData(), v.size());
+  qToLittleEndian<quint32>(crc32(p + 4, size - 4), p);
+  return size;
+}
+
+// points the index at the newest record of key, the caller holds indexLock
+// for writing unless nobody else can reach the store yet
+void LogStore::place(const QString &key, const LogLocation &loc)
+{
+  QHash<QString, LogLocation>::iterator old = index.find(key);
+  if (old != index.end()) {
+    retire(old.value());
+    old.value() = loc;
+  } else {
+    index.insert(key, loc);
+  }
+}
+
+// writes the key/value pair to the log
+void LogStore::put(QString key, int version, QString value)
+{
+  PutBatch batch;
+  Update u;
+  u.version = version;
+  u.value = value;
+  batch.append(qMakePair(key, u));
+  putBatch(batch);
+}
+
+// writes a tombstone of key to the log, its older records become dead
+void LogStore::remove(QString key, int version)
+{
+  PutBatch batch;
+  Update u;
+  u.version = version;
+  u.deleted = true;
+  batch.append(qMakePair(key, u));
+  putBatch(batch);
+}
+
+// writes the key/value pairs to the log with a single append
+void LogStore::putBatch(const PutBatch &batch)
+{
+  if (batch.isEmpty()) {
+    return;
+  }
+
+  ScopedLatency latency(Metrics::global()->storeWrite);
+  QMutexLocker locker(&mutex);
+  QByteArray records;
+  QVector<int> sizes(batch.size());
+  for (int i = 0; i < batch.size(); ++i) {
+    sizes[i] = appendRecord(records, batch.at(i).first, batch.at(i).second.version,
+                            batch.at(i).second.deleted, batch.at(i).second.value);
+  }
+
+  LogLocation loc;
+  if (!append(records, loc)) {
+    return;
+  }
+  QWriteLocker indexLocker(&indexLock);
+  QMutexLocker cacheLocker(&cacheMutex);
+  for (int i = 0; i < batch.size(); ++i) {
+    LogLocation record = loc;
+    record.size = sizes.at(i);
+    record.version = batch.at(i).second.version;
+    record.deleted = batch.at(i).second.deleted;
+    place(batch.at(i).first, record);
+    if (record.deleted) {
+      cache->remove(batch.at(i).first);
+    } else {
+      // what was just written is the likeliest to be read next
+      cache->put(batch.at(i).first, batch.at(i).second.value);
+    }
+    loc.offset += sizes.at(i);
+  }
+  Metrics::global()->cacheBytes.set(cache->bytes());
+}
+
+// flushes the active segment to disk, sealed ones were flushed when sealed
+bool LogStore::sync()
+{
+  ScopedLatency latency(Metrics::global()->storeSync);
+  QMutexLocker locker(&mutex);
+  if (active < 0 or fdatasync(segments[active].fd) != 0) {
+    qWarning() << "failed to sync segment " << active << ": " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+// Gets value from key. The cache holds only newest values, writers update
+// it along with the index, so a hit is the answer. A miss holds the index
+// still while the record is read, so that neither a newer write nor
+// compaction can get in between, and caches what it read.
+QString LogStore::get(QString key)
+{
+  Metrics *metrics = Metrics::global();
+  ScopedLatency latency(metrics->storeRead);
+  QString value;
+  {
+    QMutexLocker cacheLocker(&cacheMutex);
+    if (cache->get(key, value)) {
+      metrics->cacheHits.add();
+      return value;
+    }
+  }
+  metrics->cacheMisses.add();
+
+  QReadLocker locker(&indexLock);
+  QHash<QString, LogLocation>::const_iterator i = index.constFind(key);
+  if (i == index.constEnd()) {
+    return QString();
+  }
+
+  LogLocation loc = i.value();
+  if (loc.deleted) {
+    return QString();
+  }
+
+  int valueOffset = kHeaderSize + key.toUtf8().size();
+  QByteArray bytes(loc.size - valueOffset, 0);
+  if (!readAt(segments.value(loc.segment).fd, bytes.data(), bytes.size(), loc.offset + valueOffset)) {
+    qWarning() << "failed to read " << key << " from segment " << loc.segment;
+    return QString();
+  }
+  value = QString::fromUtf8(bytes);
+  QMutexLocker cacheLocker(&cacheMutex);
+  cache->put(key, value);
+  metrics->cacheBytes.set(cache->bytes());
+  return value;
+}
+
+QHash<QString, int> LogStore::versions()
+{
+  QReadLocker locker(&indexLock);
+  QHash<QString, int> out;
+  out.reserve(index.size());
+  for (QHash<QString, LogLocation>::const_iterator i = index.begin(); i != index.end(); ++i) {
+    out.insert(i.key(), i.value().version);
+  }
+  return out;
+}
+
+QStringList LogStore::tombstones()
+{
+  QReadLocker locker(&indexLock);
+  QStringList out;
+  for (QHash<QString, LogLocation>::const_iterator i = index.begin(); i != index.end(); ++i) {
+    if (i.value().deleted) {
+      out.append(i.key());
+    }
+  }
+  return out;
+}
+
+// Drops the tombstones of keys from the index, compaction reclaims their
+// records. The index is checkpointed right away, so that a restart never
+// replays the log from before the purge, where older records of the keys
+// would come back without the tombstone that hid them. Only a restart that
+// finds no usable checkpoint and replays the whole log can still see them.
+void LogStore::purge(const QStringList &keys)
+{
+  QMutexLocker locker(&mutex);
+  int purged = 0;
+  {
+    QWriteLocker indexLocker(&indexLock);
+    for (int i = 0; i < keys.size(); ++i) {
+      QHash<QString, LogLocation>::iterator loc = index.find(keys.at(i));
+      if (loc != index.end() and loc.value().deleted) {
+        retire(loc.value());
+        index.erase(loc);
+        ++purged;
+      }
+    }
+  }
+  if (purged > 0) {
+    writeCheckpoint();
+  }
+}
+
+// sealed segment with the largest overwritten fraction above kCompactRatio, -1 if none
+int LogStore::pickVictim()
+{
+  int best = -1;
+  double bestRatio = kCompactRatio;
+  for (QMap<int, LogSegment>::const_iterator i = segments.begin(); i != segments.end(); ++i) {
+    if (i.key() == active or i.value().size == 0) {
+      continue;
+    }
+    double ratio = (double)i.value().dead / i.value().size;
+    if (ratio >= bestRatio) {
+      best = i.key();
+      bestRatio = ratio;
+    }
+  }
+  return best;
+}
+
+// copies up to kCompactBatch live records of the victim segment into the
+// active one, and deletes the victim once all of them have moved, then
+// checkpoints the index if enough was written since the last time
+void LogStore::compact()
+{
+  QMutexLocker locker(&mutex);
+  ++idleTicks;
+  if (uncheckpointed >= kCheckpointBytes or (uncheckpointed > 0 and idleTicks >= kCheckpointTicks)) {
+    writeCheckpoint();
+  }
+
+  if (victim < 0) {
+    victim = pickVictim();
+    victimPos = 0;
+    if (victim < 0) {
+      return;
+    }
+    qDebug() << "compacting segment " << victim;
+  }
+
+  LogSegment seg = segments[victim];
+  for (int n = 0; n < kCompactBatch and victimPos < seg.size; ++n) {
+    uchar header[kHeaderSize];
+    if (!readAt(seg.fd, (char *)header, kHeaderSize, victimPos)) {
+      break;
+    }
+    quint32 keyLen = qFromLittleEndian<quint32>(header + 4);
+    quint32 valueLen = qFromLittleEndian<quint32>(header + 8);
+    int size = kHeaderSize + keyLen + valueLen;
+
+    QByteArray k(keyLen, 0);
+    readAt(seg.fd, k.data(), keyLen, victimPos + kHeaderSize);
+    // only writers change the index, and they wait for mutex
+    QString key = QString::fromUtf8(k);
+    QHash<QString, LogLocation>::const_iterator live = index.constFind(key);
+    if (live != index.constEnd() and live.value().segment == victim and live.value().offset == victimPos) {
+      QByteArray record(size, 0);
+      LogLocation loc;
+      if (!readAt(seg.fd, record.data(), size, victimPos) or !append(record, loc)) {
+        // try again next round
+        return;
+      }
+      loc.version = live.value().version;
+      loc.deleted = live.value().deleted;
+      QWriteLocker indexLocker(&indexLock);
+      index.insert(key, loc);
+    }
+    victimPos += size;
+  }
+
+  if (victimPos >= seg.size) {
+    // the copies must be on disk before the originals go away
+    fsync(segments[active].fd);
+    {
+      // readers of the victim are done once they let go of the index
+      QWriteLocker indexLocker(&indexLock);
+      segments.remove(victim);
+    }
+    close(seg.fd);
+    unlink(segmentPath(victim).toLocal8Bit().constData());
+    qDebug() << "compacted segment " << victim;
+    victim = -1;
+  }
+}
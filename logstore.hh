@@ -0,0 +1,100 @@
+#ifndef LOGSTORE_CLASS_HH
+#define LOGSTORE_CLASS_HH
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QTimer>
+
+#include "storage.hh"
+#include "valuecache.hh"
+
+// where the newest record of a key lives
+struct LogLocation
+{
+  int segment;
+  qint64 offset; // start of the record
+  int size;      // whole record, header included
+  int version;
+  bool deleted;  // the record is a tombstone
+};
+
+// One segment file per kSegmentSize bytes of appended records.
+// A record is a 16 byte little endian header, crc32 of everything after
+// the crc, key length, value length and version, followed by the UTF-8
+// key and value bytes. A tombstone is a record without value whose version
+// has the top bit set, it stays in the index until purged.
+//
+// The index is checkpointed to index.ckp every kCheckpointBytes appended,
+// or after kCheckpointTicks quiet compaction ticks, so that a restart maps
+// it in and only replays the records appended after it. The checkpoint is
+// a 16 byte header, magic, crc32 of the rest, segment count and key count,
+// then size and dead bytes of every segment, the last one being the
+// active segment up to where the checkpoint covers it, then every key
+// with its version and location.
+struct LogSegment
+{
+  int fd;
+  qint64 size;
+  qint64 dead; // bytes of records overwritten by newer ones
+};
+
+// Append-only segment log with an in memory key to record index, safe to
+// call from several threads. Writers take turns on mutex, a reader only
+// takes indexLock, which writers hold just while they change the index or
+// the segment list, never across a write to disk, a sync or a checkpoint.
+// A read of a cached key only takes cacheMutex.
+class LogStore : public QObject, public Storage
+{
+  Q_OBJECT
+
+  public:
+    LogStore();
+    ~LogStore();
+    bool open(QString dir);
+    void put(QString key, int version, QString value);
+    void remove(QString key, int version);
+    void putBatch(const PutBatch &batch);
+    bool sync();
+    QString get(QString key);
+    QHash<QString, int> versions();
+    QStringList tombstones();
+    void purge(const QStringList &keys);
+
+  public slots:
+    void compact();
+
+  private:
+    QString segmentPath(int segment);
+    bool openSegment(int segment, bool create);
+    bool recoverSegment(int segment, qint64 from);
+    bool append(const QByteArray &record, LogLocation &loc);
+    void retire(const LogLocation &loc);
+    void place(const QString &key, const LogLocation &loc);
+    int pickVictim();
+    QString checkpointPath();
+    bool loadCheckpoint(int &segment, qint64 &offset);
+    bool writeCheckpoint();
+
+    QMutex mutex;             // serializes appends, syncs, checkpoints and compaction
+    QReadWriteLock indexLock; // guards index and the segment list against the readers
+    QMutex cacheMutex;        // guards cache, taken alone or inside indexLock
+    QString dir;
+    QMap<int, LogSegment> segments; // ordered oldest first, sizes are the writers' own
+    QHash<QString, LogLocation> index;
+    ValueCache *cache; // newest values of hot keys, so reads of them skip the index and the disk
+    int active;   // segment being appended to
+    int victim;   // segment being compacted, -1 if none
+    qint64 victimPos;
+    QTimer *compactTimer;
+    qint64 uncheckpointed; // bytes appended since the last checkpoint
+    int idleTicks;         // compaction ticks since the last checkpoint
+
+    qint64 kSegmentSize, kCheckpointBytes, kCacheBytes;
+    int kCompactInterval, kCompactBatch, kCheckpointTicks;
+    double kCompactRatio;
+};
+
+#endif
@@ -1,218 +1,18 @@
 #include <unistd.h>
-#include <sys/stat.h>
-#include <iostream>
-#include <fstream>
+#include <stdlib.h>
 #include <string.h>
+#include <iostream>
 
 #include <QVBoxLayout>
 #include <QApplication>
+#include <QCoreApplication>
 #include <QDebug>
+#include <QFile>
+#include <QScopedPointer>
+#include <QTextStream>
 
 #include "main.hh"
-
-VersionTracker::VersionTracker()
-{
-  versions = new QVariantMap();
-}
-
-// returns the most recent version of the key in the QMap, 0 if non existent
-int VersionTracker::findVersion(QString key)
-{
-  if (versions->contains(key)) {
-    return (*versions)[key].toInt();
-  } else {
-    return 0;
-  }
-}
-
-// writes the key/value pair to local storage
-void FrontDialog::put(QString key, QString value)
-{
-  std::fstream fs;
-  fs.open((sock->dir_name + "/" + key).toStdString().c_str(), std::fstream::out);
-  fs << value.toStdString();
-  fs.close();
-}
-
-// gets value from key
-QString FrontDialog::get(QString key)
-{
-  std::ifstream f((sock->dir_name + "/" + key).toStdString().c_str());
-  std::string str;
-  f.seekg(0, std::ios::end);   
-  str.reserve(f.tellg());
-  f.seekg(0, std::ios::beg);
-
-  str.assign((std::istreambuf_iterator<char>(f)),
-              std::istreambuf_iterator<char>());
-  return QString(str.c_str());
-}
-
-// remove rumor with key if it exists
-void FrontDialog::eliminateRumorByKey(QString key)
-{
-  HotRumor *rumor;
-  for (int i = 0; i < hotRumors->size(); ++i) {
-    if (hotRumors->at(i)->key == key) {
-      rumor = hotRumors->at(i);
-      hotRumors->remove(i);
-      delete(rumor);
-    }
-  }
-}
-
-// attaches ack message to proper rumor
-void FrontDialog::attachAckMessage(QVariantMap msg)
-{
-  for (int i = 0; i < hotRumors->size(); ++i) {
-    HotRumor *rumor = hotRumors->at(i);
-    if (rumor->key == msg[QString("Key")].toString() and
-        rumor->version == msg[QString("Version")].toInt()) {
-      rumor->ackmsg = msg;
-    }
-  }
-}
-
-// updates versioning and writes key/value pair if necessary, returns an ack number
-int FrontDialog::processRumor(QVariantMap msg)
-{
-  QString key = msg[QString("Key")].toString();
-  QString value = msg[QString("Value")].toString();
-  int new_version = msg[QString("Version")].toInt();
-  if (vt->findVersion(key) < new_version) {
-    eliminateRumorByKey(key);
-    vt->versions->insert(key, new_version);
-    put(key, value);
-
-    msg.insert("Host", sock->address.toString());
-    msg.insert("Port", sock->boundPort);
-
-    HotRumor *rumor = new HotRumor(msg);
-    // connection to delete rumor if necessary
-    connect(rumor, SIGNAL(eliminateRumor(QString)), this, SLOT(eliminateRumorByKey(QString)));
-    // connection to send rumor
-    connect(rumor, SIGNAL(sendRandomMessage(QVariantMap)), sock, SLOT(sendRandomMessage(QVariantMap)));
-    hotRumors->append(rumor);
-    return 1;
-  } else {
-    return 0;
-  }
-}
-
-// place updates into storage
-void FrontDialog::placeUpdates(QVariantMap updates)
-{
-  for (QVariantMap::const_iterator i = updates.begin(); i != updates.end(); ++i) {
-    QVariantMap msg;
-    msg.insert(QString("Key"), i.key());
-    msg.insert(QString("Value"), i.value().toMap()[QString("Value")].toString());
-    msg.insert(QString("Version"), i.value().toMap()[QString("Version")].toInt());
-    processRumor(msg);
-  }
-}
-
-// maybe this should be in netsocket class?
-void FrontDialog::readPendingMessages()
-{
-  while (sock->hasPendingDatagrams()) {
-    QVariantMap msg = sock->deserialize();
-    if (msg.contains(QString("Key")) and msg.contains(QString("Value")) and 
-        msg.contains(QString("Version")) and msg.contains(QString("Host")) and
-        msg.contains(QString("Port"))) {
-      int ack = processRumor(msg);
-      qDebug() << "received rumor version " << msg[QString("Version")].toInt() << "sending ack " << ack;
-      sock->sendAck(ack, msg);
-    } else if (msg.contains(QString("Ack")) and msg.contains(QString("Key")) and
-        msg.contains(QString("Version"))) {
-      attachAckMessage(msg);
-    } else if (msg.contains(QString("State")) and msg.contains(QString("Host")) and
-        msg.contains(QString("Port"))) {
-      processEntropy(msg);
-    } else if (msg.contains(QString("Updates"))) {
-      placeUpdates(msg[QString("Updates")].toMap());
-    } else if (msg.contains(QString("QuorumCall")) and msg.contains(QString("Key")) and 
-        msg.contains(QString("Version"))) {
-      sendQuorumResponse(msg);
-    } else if (msg.contains(QString("QuorumAck"))) {
-      processQuorumResponse(msg);
-    }
-  }
-}
-
-// checks new state for required updates, returns required update list
-QVariantMap FrontDialog::findRequiredUpdates(QVariantMap newstate, QVariantMap oldstate)
-{
-  QVariantMap updates;
-  for (QVariantMap::const_iterator i = newstate.begin(); i != newstate.end(); ++i) {
-    if (oldstate.contains(i.key())) {
-      if (oldstate[i.key()].toInt() < i.value().toInt()) {
-        updates.insert(i.key(), i.value());
-      }
-    } else {
-      // new key here
-      updates.insert(i.key(), i.value());
-    }
-  }
-  return updates;
-}
-
-// seeks values from database and attaches them in a variantmap
-QVariantMap FrontDialog::attachValuesToUpdates(QVariantMap updates)
-{
-  QVariantMap updatesWithValues;
-  for (QVariantMap::const_iterator i = updates.begin(); i != updates.end(); ++i) {
-    QVariantMap m;
-    m.insert(QString("Version"), i.value().toInt());
-    m.insert(QString("Value"), get(i.key()));
-    updatesWithValues.insert(i.key(), m);
-  }
-  return updatesWithValues; 
-}
-
-// creates variantmap with host and port
-QVariantMap FrontDialog::createBaseMap()
-{
-  QVariantMap m;
-  m.insert(QString("Host"), sock->address.toString());
-  m.insert(QString("Port"), sock->boundPort);
-  return m;
-}
-
-// processes an anti-entropy message
-void FrontDialog::processEntropy(QVariantMap msg)
-{
-  if (msg.contains(QString("UpdatesFromOrigin")) and msg.contains(QString("UpdatesToOrigin"))) {
-    QVariantMap updatesWithValues = attachValuesToUpdates(msg[QString("UpdatesFromOrigin")].toMap());
-    QVariantMap updatemsg;
-    updatemsg.insert("Updates", updatesWithValues);
-    sock->sendResponseMessage(updatemsg, QHostAddress(msg[QString("Host")].toString()), msg[QString("Port")].toInt());
-
-    placeUpdates(msg[QString("UpdatesToOrigin")].toMap());
-  } else {
-    QVariantMap newstate = msg[QString("State")].toMap();
-    // contains keys that this node needs
-    QVariantMap updatesFromOrigin = findRequiredUpdates(newstate, *(vt->versions));
-
-    // obtaining <version, value> pairs that the messaging node requires
-    QVariantMap updatesToOrigin = attachValuesToUpdates(findRequiredUpdates(*(vt->versions), newstate));
-
-    QVariantMap ackmsg = createBaseMap();
-    ackmsg.insert("State", *(vt->versions));
-    ackmsg.insert(QString("UpdatesFromOrigin"), updatesFromOrigin);
-    ackmsg.insert(QString("UpdatesToOrigin"), updatesToOrigin);
-    
-    sock->sendResponseMessage(ackmsg, QHostAddress(msg[QString("Host")].toString()), msg[QString("Port")].toInt());
-  }
-}
-
-// sends anti entropy status
-void FrontDialog::sendAntiEntropy()
-{
-  QVariantMap msg = createBaseMap();
-  msg.insert("State", *(vt->versions));
-
-  sock->sendRandomMessage(msg);
-}
+#include "clientserver.hh"
 
 // clears all input lines in the front end dialog
 void FrontDialog::clearAllInputs()
@@ -227,79 +27,12 @@ void FrontDialog::clearAllInputs()
 // processes a put request
 void FrontDialog::putRequest()
 {
-  // invalid put request with empty key
-  if (putKeyField->text().isEmpty()) {
-    return;
-  }
-
-  // grabs input key/value
-	QString key = putKeyField->text();
-  QString value = putValueField->text();
-  qDebug() << "Adding file : " << key;
-
-  // creates message for processing
-  QVariantMap msg = createBaseMap();
-  msg.insert(QString("Key"), key);
-  msg.insert(QString("Value"), value);
-  msg.insert(QString("Version"), vt->findVersion(key) + 1);
-
-  processRumor(msg);
+  node->putRequest(putKeyField->text(), putValueField->text());
 
   // Clear the inputs to get ready for the next input message.
   clearAllInputs();
 }
 
-// processes a quorum response msg
-void FrontDialog::processQuorumResponse(QVariantMap msg)
-{
-  if (msg[QString("Key")] == quorum->key) {
-    quorum->processQuorumResponse(msg); 
-  }
-}
-
-// sending response to quorum call
-void FrontDialog::sendQuorumResponse(QVariantMap msg)
-{
-  QString key = msg[QString("Key")].toString();
-  int version = msg[QString("Version")].toInt();
-
-  // only send the value back if the version is as fresh or fresher 
-  // than the one the requester has
-  if (version <= vt->findVersion(key)) {
-    QVariantMap ackmsg = createBaseMap();
-    ackmsg.insert(QString("Key"), key);
-    ackmsg.insert(QString("Value"), get(key));
-    ackmsg.insert(QString("Version"), vt->findVersion(key));
-    ackmsg.insert(QString("QuorumAck"), QString("QuorumAck"));
-
-    sock->sendResponseMessage(ackmsg, QHostAddress(msg[QString("Host")].toString()), msg[QString("Port")].toInt());
-  }
-}
-
-// quorum over, decision made 
-void FrontDialog::quorumDecision(QString value)
-{
-  getValueField->setPlaceholderText(value);
-
-  if (quorum) {
-    delete(quorum);
-  }
-}
-
-// sends a request to all nodes for a key/value
-void FrontDialog::gatherQuorum(QString key)
-{
-  QVariantMap msg = createBaseMap();
-  msg.insert(QString("Key"), key);
-  msg.insert(QString("Version"), vt->findVersion(key));
-  msg.insert(QString("QuorumCall"), QString("QuorumCall"));
-
-  for (int i = 0; i < sock->neighbors->size(); ++i) {
-    QPair<QHostAddress, int> neighbor = sock->neighbors->at(i);
-    sock->sendResponseMessage(msg, neighbor.first, neighbor.second); 
-  }
-}
-
 // processes a get request
 void FrontDialog::getRequest()
 {
@@ -307,59 +40,40 @@ void FrontDialog::getRequest()
   if (getKeyField->text().isEmpty()) {
     return;
   }
-  
-  QString key = getKeyField->text();
-  qDebug() << "Getting file : " << key;
 
   getValueField->setPlaceholderText("please wait...");
   putKeyField->clear();
   putValueField->clear();
   deleteKeyField->clear();
 
-  quorum = new Quorum(key, get(key), vt->findVersion(key));
-  gatherQuorum(key);
-  connect(quorum, SIGNAL(quorumDecision(QString)), this, SLOT(quorumDecision(QString)));
+  getId = node->getRequest(getKeyField->text());
+}
+
+// quorum over, decision made
+void FrontDialog::showValue(quint32 id, QString key, QString value)
+{
+  if (id == getId) {
+    getValueField->setPlaceholderText(value);
+  }
 }
 
 // processes a delete request
 void FrontDialog::deleteRequest()
 {
-  // invalid delete request with empty key
-  if (deleteKeyField->text().isEmpty()) {
-    return;
-  }
-  
-  QString key = deleteKeyField->text();
-  qDebug() << "Deleting file : " << key;
+  node->deleteRequest(deleteKeyField->text());
 
   clearAllInputs();
 }
 
 // instantiates the application
-FrontDialog::FrontDialog()
+FrontDialog::FrontDialog(Node *node)
 {
 	setWindowTitle("DB");
-  vt = new VersionTracker();
-  srand(time(0));
-
-	// Create a UDP network socket
-	sock = new NetSocket();
-	if (!sock->bind())
-		exit(1); 
+  this->node = node;
 
-  sock->findNeighbors();
-
-  // directory to store key/values is just dir plus the port number, stored in directory db
-  sock->dir_name = "db/dir" + QString::number(sock->boundPort);
-  mkdir(sock->dir_name.toStdString().c_str(), S_IRWXU); // creates the directory
-
-  hotRumors = new QVector<HotRumor *>();
-
-  // starts listening for messages
-  connect(sock, SIGNAL(readyRead()),
-          this, SLOT(readPendingMessages()));
-  connect(this, SIGNAL(startRumor(QVariantMap)),
-          sock, SLOT(sendRandomMessage(QVariantMap)));
+  getId = 0;
+  connect(node, SIGNAL(getFinished(quint32, QString, QString)),
+          this, SLOT(showValue(quint32, QString, QString)));
 
   // adding put fields
 	putKeyField = new QLineEdit(this);
@@ -373,7 +87,7 @@ FrontDialog::FrontDialog()
   getValueField->setPlaceholderText("will contain value of get request");
   getValueField->setReadOnly(true);
   getButton = new QPushButton("Get (key)", this);
-  
+
   // adding delete fields
   deleteKeyField = new QLineEdit(this);
   deleteButton = new QPushButton("Delete (key)", this);
@@ -385,12 +99,6 @@ FrontDialog::FrontDialog()
   connect(deleteButton, SIGNAL(clicked()),
           this, SLOT(deleteRequest()));
 
-  // adding antientropy timer
-  kAntiEntropyTimeout = 15000;
-  antiTimer = new QTimer(this);
-  connect(antiTimer, SIGNAL(timeout()), this, SLOT(sendAntiEntropy()));
-  antiTimer->start(kAntiEntropyTimeout);
-
 	// Lay out the widgets to appear in the main window.
 	QVBoxLayout *layout = new QVBoxLayout();
 	layout->addWidget(putKeyField);
@@ -405,15 +113,180 @@ FrontDialog::FrontDialog()
 	setLayout(layout);
 }
 
+// parses HOST:PORT, the host being an address
+static bool parsePeer(QString text, Peer &peer)
+{
+  int colon = text.lastIndexOf(':');
+  bool ok = false;
+  if (colon > 0) {
+    QString host = text.left(colon);
+    if (host.startsWith("[") and host.endsWith("]")) {
+      host = host.mid(1, host.size() - 2);
+    }
+    peer.first = host == "localhost" ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(host);
+    peer.second = text.mid(colon + 1).toInt(&ok);
+  }
+  return ok and !peer.first.isNull() and peer.second > 0;
+}
+
+// reads one HOST:PORT per line, blank lines and lines starting with # are skipped
+static bool readPeers(QString path, QList<Peer> &peers)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    std::cerr << "could not open " << path.toStdString() << std::endl;
+    return false;
+  }
+  QTextStream in(&file);
+  while (!in.atEnd()) {
+    QString line = in.readLine().trimmed();
+    Peer peer;
+    if (line.isEmpty() or line.startsWith("#")) {
+      continue;
+    }
+    if (!parsePeer(line, peer)) {
+      std::cerr << "bad peer " << line.toStdString() << " in " << path.toStdString() << std::endl;
+      return false;
+    }
+    peers.append(peer);
+  }
+  return true;
+}
+
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog
+            << " [--headless] [--client-port PORT] [--client-socket PATH]"
+            << " [--durability none|batch|interval[:MS]]"
+            << " [--port PORT] [--seeds HOST:PORT,...] [--peers FILE]"
+            << " [--advertise HOST] [--replicas N] [--metrics-file PATH]"
+            << " [--trace-log PATH] [--trace-sample N] [--stale-reads MS]" << std::endl;
+}
+
+// what the command line asks of the node and its client listeners
+struct Settings
+{
+  Settings() : headless(false), clientPort(0), durability(kSyncInterval), syncInterval(50),
+               port(0), replicas(3), traceSample(0), staleReads(0) {}
+
+  bool headless;
+  int clientPort;
+  QString clientSocket;
+  Durability durability;
+  int syncInterval;
+  int port;
+  int replicas;
+  QList<Peer> seeds;
+  QHostAddress advertise;
+  QString metricsFile;
+  QString traceLog;
+  int traceSample;
+  int staleReads;
+};
+
+// configures node as settings say and starts it, then the client protocol
+// listeners that were asked for
+static bool startNode(Node *node, ClientServer *server, const Settings &settings)
+{
+  node->durability = settings.durability;
+  node->syncInterval = settings.syncInterval;
+  node->port = settings.port;
+  node->seeds = settings.seeds;
+  node->advertise = settings.advertise;
+  node->replicationFactor = settings.replicas;
+  node->metricsFile = settings.metricsFile;
+  node->traceLog = settings.traceLog;
+  node->traceSample = settings.traceSample;
+  node->staleReads = settings.staleReads;
+  if (!node->start()) {
+    return false;
+  }
+
+  if (settings.clientPort > 0 and !server->listenTcp(settings.clientPort)) {
+    return false;
+  }
+  if (!settings.clientSocket.isEmpty() and !server->listenLocal(settings.clientSocket)) {
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char **argv)
 {
-	// Initialize Qt toolkit
-	QApplication app(argc,argv);
+  Settings settings;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--headless")) {
+      settings.headless = true;
+    } else if (!strcmp(argv[i], "--client-port") and i + 1 < argc) {
+      settings.clientPort = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--client-socket") and i + 1 < argc) {
+      settings.clientSocket = QString(argv[++i]);
+    } else if (!strcmp(argv[i], "--port") and i + 1 < argc) {
+      settings.port = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seeds") and i + 1 < argc) {
+      QStringList list = QString(argv[++i]).split(',', QString::SkipEmptyParts);
+      for (int j = 0; j < list.size(); ++j) {
+        Peer peer;
+        if (!parsePeer(list.at(j), peer)) {
+          usage(argv[0]);
+          return 2;
+        }
+        settings.seeds.append(peer);
+      }
+    } else if (!strcmp(argv[i], "--replicas") and i + 1 < argc) {
+      settings.replicas = qMax(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--metrics-file") and i + 1 < argc) {
+      settings.metricsFile = QString(argv[++i]);
+    } else if (!strcmp(argv[i], "--trace-log") and i + 1 < argc) {
+      settings.traceLog = QString(argv[++i]);
+    } else if (!strcmp(argv[i], "--trace-sample") and i + 1 < argc) {
+      settings.traceSample = qMax(0, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--stale-reads") and i + 1 < argc) {
+      settings.staleReads = qMax(0, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--advertise") and i + 1 < argc) {
+      settings.advertise = QHostAddress(QString(argv[++i]));
+    } else if (!strcmp(argv[i], "--peers") and i + 1 < argc) {
+      if (!readPeers(QString(argv[++i]), settings.seeds)) {
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--durability") and i + 1 < argc) {
+      ++i;
+      if (!strcmp(argv[i], "none")) {
+        settings.durability = kSyncNone;
+      } else if (!strcmp(argv[i], "batch")) {
+        settings.durability = kSyncBatch;
+      } else if (!strncmp(argv[i], "interval", 8)) {
+        // interval or interval:MS
+        settings.durability = kSyncInterval;
+        if (argv[i][8] == ':') {
+          settings.syncInterval = qMax(1, atoi(argv[i] + 9));
+        }
+      } else {
+        usage(argv[0]);
+        return 2;
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
 
-	// Create an initial chat dialog window
-	FrontDialog dialog;
-	dialog.show();
+  // Initialize Qt toolkit, a server daemon needs no window system
+  QScopedPointer<QCoreApplication> app(settings.headless ? new QCoreApplication(argc, argv)
+                                                         : new QApplication(argc, argv));
+
+  Node node;
+  ClientServer server(&node);
+  if (!startNode(&node, &server, settings))
+    return 1;
+
+  // Create an initial dialog window
+  QScopedPointer<FrontDialog> dialog;
+  if (!settings.headless) {
+    dialog.reset(new FrontDialog(&node));
+    dialog->show();
+  }
 
-	// Enter the Qt main loop; everything else is event driven
-	return app.exec();
+  // Enter the Qt main loop; everything else is event driven
+  return app->exec();
 }
@@ -7,65 +7,29 @@
 #include <QTextEdit>
 #include <QLineEdit>
 #include <QKeyEvent>
-#include <QMap>
-#include <QVariantMap>
 #include <QPushButton>
-#include <QTimer>
 
-#include "netsocket.hh"
-#include "hotrumor.hh"
-#include "quorum.hh"
-
-class VersionTracker
-{
-  public:
-    VersionTracker();
-    int findVersion(QString key); 
-
-    QVariantMap *versions; // map of key to version
-};
+#include "node.hh"
 
 class FrontDialog : public QDialog
 {
 	Q_OBJECT
 
   public:
-    FrontDialog();
-    void put(QString key, QString value);
-    QString get(QString key);
-    int processRumor(QVariantMap);
-    void attachAckMessage(QVariantMap);
-    void processEntropy(QVariantMap);
-    void placeUpdates(QVariantMap);
-    void gatherQuorum(QString);
-    void processQuorumResponse(QVariantMap msg);
-    void sendQuorumResponse(QVariantMap);
-    QVariantMap createBaseMap();
-    QVariantMap attachValuesToUpdates(QVariantMap);
-    QVariantMap findRequiredUpdates(QVariantMap, QVariantMap);
+    FrontDialog(Node *node);
 
-    NetSocket *sock;
-    VersionTracker *vt;
-    QVector<HotRumor *> *hotRumors;
-    QTimer *antiTimer;
-    Quorum *quorum;
+    Node *node;
 
   public slots:
     void putRequest();
     void getRequest();
     void deleteRequest();
-    void readPendingMessages();
-    void eliminateRumorByKey(QString key);
-    void sendAntiEntropy();
-    void quorumDecision(QString);
-
-  signals:
-    void antiEntropy();
-    void startRumor(QVariantMap msg);
+    void showValue(quint32 id, QString key, QString value);
 
   private:
     void clearAllInputs();
 
+    quint32 getId; // id of the read the value field waits for
     QLineEdit *putKeyField;
     QLineEdit *putValueField;
     QLineEdit *getKeyField;
@@ -75,7 +39,6 @@ class FrontDialog : public QDialog
     QPushButton *putButton;
     QPushButton *getButton;
     QPushButton *deleteButton;
-    int kAntiEntropyTimeout;
 };
 
 #endif
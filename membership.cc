@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include <QDebug>
+#include <QNetworkInterface>
+
+#include "membership.hh"
+
+Membership::Membership(Transport *transport, const QList<Peer> &seeds, Clock *clock)
+{
+  this->transport = transport;
+  this->clock = clock;
+  self = transport->self();
+  // seconds since the epoch, so a restarted node outranks what is
+  // remembered about its previous run
+  incarnation = time(0);
+  probeId = 0;
+  probing = false;
+  acked = false;
+  probeSent = 0;
+  rounds = 0;
+  kProbeInterval = 1000;
+  kProbeTimeout = 300;   // ms before the ping is retried through others
+  kIndirect = 3;         // members asked to ping a silent target
+  kSuspectTimeout = 5000;
+  kMaxGossip = 8;        // changes piggybacked per message
+  kRetransmit = 3;       // times log2(n) a change is repeated
+  kReviveEvery = 10;     // every that many probes one goes to a dead member
+  localAddresses = QNetworkInterface::allAddresses();
+
+  // seeds are taken to be up until they fail a probe
+  for (int i = 0; i < seeds.size(); ++i) {
+    if (isSelf(seeds.at(i))) {
+      continue;
+    }
+    Member m;
+    m.state = kMemberAlive;
+    m.incarnation = 0;
+    m.since = 0;
+    members.insert(seeds.at(i), m);
+  }
+  refresh();
+
+  clock->every(kProbeInterval, this, SLOT(probe()));
+}
+
+int Membership::size() const
+{
+  return members.size();
+}
+
+// every member heard of, dead ones included
+QList<Peer> Membership::all() const
+{
+  return members.keys();
+}
+
+bool Membership::isSelf(const Peer &peer) const
+{
+  return peer.second == self.second and
+         (peer.first == self.first or peer.first.isLoopback() or localAddresses.contains(peer.first));
+}
+
+// settles the last probe and sends the next one
+void Membership::probe()
+{
+  qint64 now = clock->now();
+
+  if (probing and !acked) {
+    QHash<Peer, Member>::iterator m = members.find(target);
+    if (m != members.end() and m.value().state == kMemberAlive) {
+      change(target, m.value(), kMemberSuspect, m.value().incarnation);
+    }
+  }
+  probing = false;
+
+  for (QHash<Peer, Member>::iterator m = members.begin(); m != members.end(); ++m) {
+    if (m.value().state == kMemberSuspect and now - m.value().since > kSuspectTimeout) {
+      change(m.key(), m.value(), kMemberDead, m.value().incarnation);
+    }
+  }
+
+  QHash<quint32, qint64>::iterator r = relayTimes.begin();
+  while (r != relayTimes.end()) {
+    if (now - r.value() > kProbeInterval) {
+      relays.remove(r.key());
+      r = relayTimes.erase(r);
+    } else {
+      ++r;
+    }
+  }
+
+  // now and then try a dead member, it may be back or reachable again
+  if (++rounds % kReviveEvery == 0) {
+    QList<Peer> dead;
+    for (QHash<Peer, Member>::const_iterator m = members.begin(); m != members.end(); ++m) {
+      if (m.value().state == kMemberDead) {
+        dead.append(m.key());
+      }
+    }
+    if (!dead.isEmpty()) {
+      Message ping(kMsgPing);
+      ping.id = ++probeId;
+      send(ping, dead.at(rand() % dead.size()));
+    }
+  }
+
+  // round robin over a fresh shuffle, so every member is probed once per round
+  if (order.isEmpty()) {
+    for (QHash<Peer, Member>::const_iterator m = members.begin(); m != members.end(); ++m) {
+      if (m.value().state != kMemberDead) {
+        order.append(m.key());
+      }
+    }
+    for (int i = order.size() - 1; i > 0; --i) {
+      order.swap(i, rand() % (i + 1));
+    }
+  }
+  while (!order.isEmpty()) {
+    Peer next = order.takeFirst();
+    QHash<Peer, Member>::const_iterator m = members.constFind(next);
+    if (m == members.constEnd() or m.value().state == kMemberDead) {
+      continue;
+    }
+
+    target = next;
+    probing = true;
+    acked = false;
+    Message ping(kMsgPing);
+    ping.id = ++probeId;
+    send(ping, target);
+    probeSent = now;
+    clock->after(kProbeTimeout, this, SLOT(probeTimeout()));
+    break;
+  }
+}
+
+// the target did not answer in time, ask others to try
+void Membership::probeTimeout()
+{
+  // the timeout of an earlier probe can't be taken back, it finds nothing to do
+  if (!probing or acked or clock->now() - probeSent < kProbeTimeout) {
+    return;
+  }
+
+  QList<Peer> helpers;
+  for (QHash<Peer, Member>::const_iterator m = members.begin(); m != members.end(); ++m) {
+    if (m.value().state == kMemberAlive and m.key() != target) {
+      helpers.append(m.key());
+    }
+  }
+  for (int i = 0; i < kIndirect and !helpers.isEmpty(); ++i) {
+    Message req(kMsgPingReq);
+    req.id = probeId;
+    req.target.host = target.first;
+    req.target.port = target.second;
+    req.target.state = kMemberAlive;
+    req.target.incarnation = 0;
+    send(req, helpers.takeAt(rand() % helpers.size()));
+  }
+}
+
+void Membership::processMessage(const Message &msg)
+{
+  Peer from = qMakePair(msg.host, msg.port);
+  // whoever talks to us is alive, at the incarnation it says
+  apply(from, kMemberAlive, (quint32)msg.version);
+  for (int i = 0; i < msg.members.size(); ++i) {
+    const Gossip &g = msg.members.at(i);
+    apply(qMakePair(g.host, g.port), g.state, g.incarnation);
+  }
+  // a member we gave up on has to hear it to refute it
+  QHash<Peer, Member>::const_iterator self = members.constFind(from);
+  if (self != members.constEnd() and self.value().state != kMemberAlive) {
+    gossip(from);
+  }
+
+  switch (msg.type) {
+    case kMsgPing: {
+      Message ack(kMsgPingAck);
+      ack.id = msg.id;
+      send(ack, from);
+      break;
+    }
+    case kMsgPingReq: {
+      // ping the target under an id of our own and pass its ack on
+      Message ping(kMsgPing);
+      ping.id = ++probeId;
+      relays.insert(ping.id, qMakePair(from, msg.id));
+      relayTimes.insert(ping.id, clock->now());
+      send(ping, qMakePair(msg.target.host, msg.target.port));
+      break;
+    }
+    case kMsgPingAck: {
+      if (probing and msg.id == probeId) {
+        acked = true;
+        break;
+      }
+      QHash<quint32, QPair<Peer, quint32> >::iterator r = relays.find(msg.id);
+      if (r != relays.end()) {
+        Message ack(kMsgPingAck);
+        ack.id = r.value().second;
+        send(ack, r.value().first);
+        relayTimes.remove(r.key());
+        relays.erase(r);
+      }
+      break;
+    }
+  }
+}
+
+// merges what someone believes about peer into what we believe
+void Membership::apply(const Peer &peer, int state, quint32 incarnation)
+{
+  if (isSelf(peer)) {
+    if (state != kMemberAlive and incarnation >= this->incarnation) {
+      // refute, every message we send carries the new incarnation
+      this->incarnation = incarnation + 1;
+      qDebug() << "refuting suspicion, incarnation now " << this->incarnation;
+    }
+    return;
+  }
+
+  QHash<Peer, Member>::iterator i = members.find(peer);
+  if (i == members.end()) {
+    if (state != kMemberDead) {
+      Member m;
+      m.state = -1;
+      m.incarnation = incarnation;
+      i = members.insert(peer, m);
+      change(peer, i.value(), state, incarnation);
+    }
+    return;
+  }
+
+  Member &m = i.value();
+  switch (state) {
+    case kMemberAlive:
+      if (incarnation > m.incarnation) {
+        if (m.state == kMemberAlive) {
+          m.incarnation = incarnation;
+        } else {
+          change(peer, m, kMemberAlive, incarnation);
+        }
+      }
+      break;
+    case kMemberSuspect:
+      if (m.state == kMemberAlive and incarnation >= m.incarnation) {
+        change(peer, m, kMemberSuspect, incarnation);
+      } else if (m.state == kMemberSuspect and incarnation > m.incarnation) {
+        m.incarnation = incarnation;
+      }
+      break;
+    case kMemberDead:
+      if (m.state != kMemberDead and incarnation >= m.incarnation) {
+        change(peer, m, kMemberDead, incarnation);
+      }
+      break;
+  }
+}
+
+void Membership::change(const Peer &peer, Member &m, int state, quint32 incarnation)
+{
+  static const char *names[] = { "alive", "suspect", "dead" };
+  qDebug() << "member " << peer.first.toString() << ":" << peer.second << " is " << names[state];
+
+  bool wasAlive = m.state == kMemberAlive;
+  bool joined = m.state < 0;
+  m.state = state;
+  m.incarnation = incarnation;
+  m.since = clock->now();
+  gossip(peer);
+  if (joined or wasAlive != (state == kMemberAlive)) {
+    refresh();
+  }
+}
+
+// queues the current belief about peer to be piggybacked
+void Membership::gossip(const Peer &peer)
+{
+  rumors.insert(peer, 0);
+}
+
+// attaches the least spread changes, dropping those spread often enough
+void Membership::attachGossip(Message &msg)
+{
+  int limit = kRetransmit * (int)ceil(log2(members.size() + 2));
+  QList<QPair<int, Peer> > byCount;
+  for (QHash<Peer, int>::const_iterator r = rumors.begin(); r != rumors.end(); ++r) {
+    byCount.append(qMakePair(r.value(), r.key()));
+  }
+
+  while (!byCount.isEmpty() and msg.members.size() < kMaxGossip) {
+    int least = 0;
+    for (int i = 1; i < byCount.size(); ++i) {
+      if (byCount.at(i).first < byCount.at(least).first) {
+        least = i;
+      }
+    }
+    Peer peer = byCount.takeAt(least).second;
+    QHash<Peer, Member>::const_iterator m = members.constFind(peer);
+    if (m == members.constEnd()) {
+      rumors.remove(peer);
+      continue;
+    }
+
+    Gossip g;
+    g.host = peer.first;
+    g.port = peer.second;
+    g.state = m.value().state;
+    g.incarnation = m.value().incarnation;
+    msg.members.append(g);
+    if (++rumors[peer] >= limit) {
+      rumors.remove(peer);
+    }
+  }
+}
+
+void Membership::send(Message msg, const Peer &peer)
+{
+  msg.version = (int)incarnation;
+  attachGossip(msg);
+  transport->send(msg, peer);
+}
+
+// the neighbors are the members believed alive
+void Membership::refresh()
+{
+  neighbors.clear();
+  for (QHash<Peer, Member>::const_iterator m = members.begin(); m != members.end(); ++m) {
+    if (m.value().state == kMemberAlive) {
+      neighbors.append(m.key());
+    }
+  }
+  emit changed();
+}
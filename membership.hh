@@ -0,0 +1,87 @@
+#ifndef MEMBERSHIP_CLASS_HH
+#define MEMBERSHIP_CLASS_HH
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+#include "clock.hh"
+#include "message.hh"
+#include "transport.hh"
+
+enum MemberState
+{
+  kMemberAlive = 0,
+  kMemberSuspect = 1,
+  kMemberDead = 2
+};
+
+struct Member
+{
+  int state;
+  quint32 incarnation; // bumped only by the member itself, to refute suspicion
+  qint64 since;        // ms of the last change of state
+};
+
+// SWIM style membership and failure detection.
+// Every kProbeInterval ms the next member in a shuffled round robin is
+// pinged. If it does not ack within kProbeTimeout ms, kIndirect other
+// members are asked to ping it on our behalf, and if no ack came back by
+// the next probe it becomes suspect. A suspect that does not refute the
+// suspicion with a higher incarnation within kSuspectTimeout ms is dead.
+// Changes of state ride along on pings and acks, each is repeated about
+// kRetransmit * log2(n) times. The members believed alive are kept in
+// neighbors, so rumors, reads and anti-entropy only go there.
+class Membership : public QObject
+{
+  Q_OBJECT
+
+  public:
+    Membership(Transport *transport, const QList<Peer> &seeds, Clock *clock = Clock::wall());
+    void processMessage(const Message &msg);
+    int size() const;
+    QList<Peer> all() const;
+
+    QVector<Peer> neighbors; // <address, port> of the members believed alive
+
+  public slots:
+    void probe();
+    void probeTimeout();
+
+  signals:
+    void changed(); // a member joined, came alive or stopped being alive
+
+  private:
+    bool isSelf(const Peer &peer) const;
+    void apply(const Peer &peer, int state, quint32 incarnation);
+    void change(const Peer &peer, Member &m, int state, quint32 incarnation);
+    void gossip(const Peer &peer);
+    void attachGossip(Message &msg);
+    void send(Message msg, const Peer &peer);
+    void refresh();
+
+    Transport *transport;
+    Peer self;
+    QHash<Peer, Member> members; // everyone but this node
+    QHash<Peer, int> rumors;     // changes still to spread, by times sent
+    QList<Peer> order;           // probe order for this round
+    quint32 incarnation;
+    QList<QHostAddress> localAddresses;
+
+    // the probe in flight
+    Peer target;
+    quint32 probeId;
+    bool probing, acked;
+    qint64 probeSent; // ms on clock
+
+    // ping requests we forward, by the id of our own ping
+    QHash<quint32, QPair<Peer, quint32> > relays;
+    QHash<quint32, qint64> relayTimes;
+
+    Clock *clock;
+    int rounds;
+    int kProbeInterval, kProbeTimeout, kIndirect, kSuspectTimeout, kMaxGossip, kRetransmit, kReviveEvery;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "merkle.hh"
+
+// 64 bit fnv-1a over the UTF-8 bytes, qHash is seeded per process so it
+// can't be compared across nodes
+static quint64 keyHash(const QString &key)
+{
+  QByteArray utf8 = key.toUtf8();
+  quint64 h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < utf8.size(); ++i) {
+    h ^= (uchar)utf8.at(i);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// splitmix64 finalizer
+static quint64 mix(quint64 h)
+{
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+static quint64 entryHash(const QString &key, int version)
+{
+  return mix(keyHash(key) + mix((quint64)(quint32)version));
+}
+
+MerkleTree::MerkleTree()
+{
+  nodes.fill(0, 1 << (kDepth + 1));
+}
+
+quint32 MerkleTree::leafOf(QString key)
+{
+  return (1u << kDepth) + (quint32)(keyHash(key) >> (64 - kDepth));
+}
+
+bool MerkleTree::isNode(quint32 node) const
+{
+  return node >= kRoot and node < (quint32)nodes.size();
+}
+
+bool MerkleTree::isLeaf(quint32 node) const
+{
+  return node >= (1u << kDepth) and node < (quint32)nodes.size();
+}
+
+quint64 MerkleTree::hash(quint32 node) const
+{
+  return nodes.at(node);
+}
+
+// replaces the <key, oldVersion> entry with <key, newVersion> in leaf, the
+// leafOf(key), oldVersion 0 for a new key and newVersion 0 for a key that
+// is forgotten
+void MerkleTree::update(quint32 leaf, const QString &key, int oldVersion, int newVersion)
+{
+  quint32 node = leaf;
+  if (oldVersion > 0) {
+    nodes[node] ^= entryHash(key, oldVersion);
+  }
+  if (newVersion > 0) {
+    nodes[node] ^= entryHash(key, newVersion);
+  }
+
+  // empty subtrees stay 0 so they look alike without hashing
+  for (node >>= 1; node >= kRoot; node >>= 1) {
+    quint64 left = nodes.at(2 * node);
+    quint64 right = nodes.at(2 * node + 1);
+    nodes[node] = (left == 0 and right == 0) ? 0 : mix(left ^ mix(right + node));
+  }
+}
+
+// the nodes levels below node, or the leaves under it if they are closer
+QList<quint32> MerkleTree::descendants(quint32 node, int levels) const
+{
+  QList<quint32> out;
+  int level = 0;
+  for (quint32 n = node; n > kRoot; n >>= 1) {
+    ++level;
+  }
+  levels = qMin(levels, kDepth - level);
+
+  quint32 first = node << levels;
+  for (quint32 n = first; n < first + (1u << levels); ++n) {
+    out.append(n);
+  }
+  return out;
+}
@@ -0,0 +1,34 @@
+#ifndef MERKLE_CLASS_HH
+#define MERKLE_CLASS_HH
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// Hash tree over the key/version space of a node.
+// Keys are spread over 2^kDepth leaves by a hash that is the same on every
+// node. A leaf hash is the xor of the hashes of its <key, version> entries,
+// so it is updated in place, and every inner node mixes its two children.
+// Nodes are numbered like a heap: the root is 1, the children of n are 2n
+// and 2n + 1, and the leaves are 2^kDepth .. 2^(kDepth + 1) - 1. Only the
+// hashes are kept here, the version table knows which keys are in a leaf.
+class MerkleTree
+{
+  public:
+    MerkleTree();
+    void update(quint32 leaf, const QString &key, int oldVersion, int newVersion);
+    quint64 hash(quint32 node) const;
+    bool isNode(quint32 node) const;
+    bool isLeaf(quint32 node) const;
+    QList<quint32> descendants(quint32 node, int levels) const;
+
+    static quint32 leafOf(QString key);
+
+    static const int kDepth = 16;
+    static const quint32 kRoot = 1;
+
+  private:
+    QVector<quint64> nodes;
+};
+
+#endif
@@ -0,0 +1,440 @@
+#include "message.hh"
+
+// appends v as an unsigned LEB128 varint
+static void putVarint(QByteArray &out, quint64 v)
+{
+  while (v >= 0x80) {
+    out.append((char)((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.append((char)v);
+}
+
+// trace ids are random, they would not get shorter as varints
+static void putFixed(QByteArray &out, quint64 v)
+{
+  for (int b = 0; b < 8; ++b) {
+    out.append((char)(v >> (8 * b)));
+  }
+}
+
+// a version with the tombstone flag in its low bit and the trace flag
+// above it, followed by the trace if there is one
+static void putVersion(QByteArray &out, int version, bool deleted, const Trace &trace)
+{
+  putVarint(out, ((quint64)(quint32)version << 2) | (trace.id ? 2 : 0) | (deleted ? 1 : 0));
+  if (trace.id) {
+    putFixed(out, trace.id);
+    putVarint(out, (quint64)trace.origin);
+    putVarint(out, (quint32)trace.hops);
+  }
+}
+
+static void putString(QByteArray &out, const QString &s)
+{
+  QByteArray utf8 = s.toUtf8();
+  putVarint(out, utf8.size());
+  out.append(utf8);
+}
+
+static void putVersions(QByteArray &out, const VersionMap &versions)
+{
+  putVarint(out, versions.size());
+  for (VersionMap::const_iterator i = versions.begin(); i != versions.end(); ++i) {
+    putString(out, i.key());
+    putVarint(out, (quint32)i.value());
+  }
+}
+
+static void putUpdates(QByteArray &out, const UpdateMap &updates)
+{
+  putVarint(out, updates.size());
+  for (UpdateMap::const_iterator i = updates.begin(); i != updates.end(); ++i) {
+    putString(out, i.key());
+    putVersion(out, i.value().version, i.value().deleted, i.value().trace);
+    putString(out, i.value().value);
+  }
+}
+
+static void putNodes(QByteArray &out, const QVector<quint32> &nodes)
+{
+  putVarint(out, nodes.size());
+  for (int i = 0; i < nodes.size(); ++i) {
+    putVarint(out, nodes.at(i));
+  }
+}
+
+// hosts go out as their textual form, so v4 and v6 look the same on the wire
+static void putGossip(QByteArray &out, const Gossip &g)
+{
+  putString(out, g.host.toString());
+  putVarint(out, (quint32)g.port);
+  putVarint(out, g.state);
+  putVarint(out, g.incarnation);
+}
+
+static void putMembers(QByteArray &out, const QList<Gossip> &members)
+{
+  putVarint(out, members.size());
+  for (int i = 0; i < members.size(); ++i) {
+    putGossip(out, members.at(i));
+  }
+}
+
+// hashes are fixed 8 bytes, they would not get shorter as varints
+static void putHashes(QByteArray &out, const QVector<quint64> &hashes)
+{
+  for (int i = 0; i < hashes.size(); ++i) {
+    putFixed(out, hashes.at(i));
+  }
+}
+
+// cursor over a received datagram, every read fails once the data runs out
+class Reader
+{
+  public:
+    Reader(const char *data, int size) : p(data), end(data + size), ok(true) {}
+
+    quint64 varint()
+    {
+      quint64 v = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+          ok = false;
+          return 0;
+        }
+        quint8 b = *p++;
+        v |= (quint64)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+          return v;
+        }
+      }
+      ok = false;
+      return 0;
+    }
+
+    quint64 fixed()
+    {
+      if (end - p < 8) {
+        ok = false;
+        return 0;
+      }
+      quint64 v = 0;
+      for (int b = 0; b < 8; ++b) {
+        v |= (quint64)(quint8)*p++ << (8 * b);
+      }
+      return v;
+    }
+
+    void version(int &version, bool &deleted, Trace &trace)
+    {
+      quint64 v = varint();
+      version = (int)(v >> 2);
+      deleted = v & 1;
+      if (v & 2) {
+        trace.id = fixed();
+        trace.origin = (qint64)varint();
+        trace.hops = (int)varint();
+      }
+    }
+
+    QString string()
+    {
+      quint64 len = varint();
+      if (!ok or len > (quint64)(end - p)) {
+        ok = false;
+        return QString();
+      }
+      QString s = QString::fromUtf8(p, (int)len);
+      p += len;
+      return s;
+    }
+
+    void versions(VersionMap &versions)
+    {
+      quint64 n = varint();
+      for (quint64 i = 0; i < n and ok; ++i) {
+        QString key = string();
+        versions.insert(key, (int)varint());
+      }
+    }
+
+    void updates(UpdateMap &updates)
+    {
+      quint64 n = varint();
+      for (quint64 i = 0; i < n and ok; ++i) {
+        QString key = string();
+        Update u;
+        version(u.version, u.deleted, u.trace);
+        u.value = string();
+        updates.insert(key, u);
+      }
+    }
+
+    void nodes(QVector<quint32> &nodes)
+    {
+      quint64 n = varint();
+      if (n > (quint64)(end - p)) {
+        ok = false;
+        return;
+      }
+      nodes.reserve(n);
+      for (quint64 i = 0; i < n and ok; ++i) {
+        nodes.append((quint32)varint());
+      }
+    }
+
+    void gossip(Gossip &g)
+    {
+      g.host = QHostAddress(string());
+      g.port = (int)varint();
+      g.state = (quint8)varint();
+      g.incarnation = (quint32)varint();
+    }
+
+    void members(QList<Gossip> &members)
+    {
+      quint64 n = varint();
+      for (quint64 i = 0; i < n and ok; ++i) {
+        Gossip g;
+        gossip(g);
+        members.append(g);
+      }
+    }
+
+    void hashes(QVector<quint64> &hashes, int n)
+    {
+      if ((qint64)n * 8 > end - p) {
+        ok = false;
+        return;
+      }
+      hashes.reserve(n);
+      for (int i = 0; i < n; ++i) {
+        hashes.append(fixed());
+      }
+    }
+
+    const char *p, *end;
+    bool ok;
+};
+
+Message::Message()
+{
+  type = kMsgNone;
+  ack = 0;
+  id = 0;
+  seq = 0;
+  total = 0;
+  version = 0;
+  deleted = false;
+  port = 0;
+}
+
+Message::Message(quint8 type)
+{
+  this->type = type;
+  ack = 0;
+  id = 0;
+  seq = 0;
+  total = 0;
+  version = 0;
+  deleted = false;
+  port = 0;
+}
+
+// serializes the message into a datagram
+QByteArray Message::encode() const
+{
+  QByteArray out;
+  out.reserve(16 + key.size() + value.size());
+  out.append((char)kWireVersion);
+  out.append((char)type);
+
+  switch (type) {
+    case kMsgRumor:
+      putVersion(out, version, deleted, trace);
+      putString(out, key);
+      putString(out, value);
+      break;
+    case kMsgQuorumAck:
+      putVarint(out, id);
+      putVersion(out, version, deleted, Trace());
+      putString(out, key);
+      putString(out, value);
+      break;
+    case kMsgAck:
+      putVarint(out, ((quint64)(quint32)ack << 1) | (trace.id ? 1 : 0));
+      if (trace.id) {
+        putFixed(out, trace.id);
+      }
+      putVarint(out, (quint32)version);
+      putString(out, key);
+      break;
+    case kMsgQuorumCall:
+      putVarint(out, id);
+      putVarint(out, (quint32)version);
+      putString(out, key);
+      break;
+    case kMsgState:
+      putVersions(out, state);
+      putNodes(out, nodes);
+      putVarint(out, seq);
+      break;
+    case kMsgStateReply:
+      putVersions(out, state);
+      putVersions(out, wanted);
+      putUpdates(out, updates);
+      putVarint(out, seq);
+      break;
+    case kMsgUpdates:
+    case kMsgRumorBatch:
+      putUpdates(out, updates);
+      break;
+    case kMsgQuorumBatchCall:
+      putVarint(out, id);
+      putVersions(out, state);
+      break;
+    case kMsgQuorumBatchAck:
+      putVarint(out, id);
+      putUpdates(out, updates);
+      break;
+    case kMsgTree:
+      putNodes(out, nodes);
+      putHashes(out, hashes);
+      break;
+    case kMsgBatch:
+      for (int i = 0; i < parts.size(); ++i) {
+        putVarint(out, parts.at(i).size());
+        out.append(parts.at(i));
+      }
+      break;
+    case kMsgChunk:
+      putVarint(out, id);
+      putVarint(out, seq);
+      putVarint(out, total);
+      out.append(payload);
+      break;
+    case kMsgChunkAck:
+      putVarint(out, id);
+      putVarint(out, seq);
+      putNodes(out, sacks);
+      break;
+    case kMsgPing:
+    case kMsgPingAck:
+      putVarint(out, id);
+      putVarint(out, (quint32)version);
+      putMembers(out, members);
+      break;
+    case kMsgPingReq:
+      putVarint(out, id);
+      putVarint(out, (quint32)version);
+      putGossip(out, target);
+      putMembers(out, members);
+      break;
+  }
+  return out;
+}
+
+// parses a datagram, returns false if it is truncated or of an unknown version
+bool Message::decode(const char *data, int size)
+{
+  if (size < 2 or (quint8)data[0] != kWireVersion) {
+    return false;
+  }
+  type = (quint8)data[1];
+  Reader in(data + 2, size - 2);
+
+  switch (type) {
+    case kMsgRumor:
+      in.version(version, deleted, trace);
+      key = in.string();
+      value = in.string();
+      break;
+    case kMsgQuorumAck:
+      id = (quint32)in.varint();
+      in.version(version, deleted, trace);
+      key = in.string();
+      value = in.string();
+      break;
+    case kMsgAck: {
+      quint64 flagged = in.varint();
+      ack = (int)(flagged >> 1);
+      if (flagged & 1) {
+        trace.id = in.fixed();
+      }
+      version = (int)in.varint();
+      key = in.string();
+      break;
+    }
+    case kMsgQuorumCall:
+      id = (quint32)in.varint();
+      version = (int)in.varint();
+      key = in.string();
+      break;
+    case kMsgState:
+      in.versions(state);
+      in.nodes(nodes);
+      seq = in.varint();
+      break;
+    case kMsgStateReply:
+      in.versions(state);
+      in.versions(wanted);
+      in.updates(updates);
+      seq = in.varint();
+      break;
+    case kMsgUpdates:
+    case kMsgRumorBatch:
+      in.updates(updates);
+      break;
+    case kMsgQuorumBatchCall:
+      id = (quint32)in.varint();
+      in.versions(state);
+      break;
+    case kMsgQuorumBatchAck:
+      id = (quint32)in.varint();
+      in.updates(updates);
+      break;
+    case kMsgTree:
+      in.nodes(nodes);
+      in.hashes(hashes, nodes.size());
+      break;
+    case kMsgBatch:
+      while (in.ok and in.p < in.end) {
+        quint64 len = in.varint();
+        if (!in.ok or len > (quint64)(in.end - in.p)) {
+          return false;
+        }
+        parts.append(QByteArray(in.p, (int)len));
+        in.p += len;
+      }
+      break;
+    case kMsgChunk:
+      id = (quint32)in.varint();
+      seq = in.varint();
+      total = (quint32)in.varint();
+      if (in.ok) {
+        payload = QByteArray(in.p, (int)(in.end - in.p));
+      }
+      break;
+    case kMsgChunkAck:
+      id = (quint32)in.varint();
+      seq = in.varint();
+      in.nodes(sacks);
+      break;
+    case kMsgPing:
+    case kMsgPingAck:
+      id = (quint32)in.varint();
+      version = (int)in.varint();
+      in.members(members);
+      break;
+    case kMsgPingReq:
+      id = (quint32)in.varint();
+      version = (int)in.varint();
+      in.gossip(target);
+      in.members(members);
+      break;
+    default:
+      return false;
+  }
+  return in.ok;
+}
@@ -0,0 +1,126 @@
+#ifndef MESSAGE_CLASS_HH
+#define MESSAGE_CLASS_HH
+
+#include <QByteArray>
+#include <QList>
+#include <QHostAddress>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+// Binary wire format spoken between nodes.
+// Every datagram starts with a fixed two byte header, the wire version and
+// the message type, followed by the fields of that type in a fixed order.
+// Integers are unsigned LEB128 varints, strings are a varint byte length
+// followed by UTF-8 bytes, maps are a varint count followed by the entries.
+// The version of a rumor, an update or a quorum ack goes out shifted left
+// by two, with the low bit set if it is a tombstone and the next one if a
+// trace follows: the trace id as 8 fixed bytes, the origin time and the hop
+// count. An ack is flagged the same way and followed by the trace id alone.
+enum MessageType
+{
+  kMsgNone = 0,
+  kMsgRumor = 1,      // version (and deleted), key, value
+  kMsgAck = 2,        // ack, version, key
+  kMsgState = 3,      // state, nodes (the tree leaves state covers), seq
+  kMsgStateReply = 4, // state, wanted, updates, seq (echoed)
+  kMsgUpdates = 5,    // updates, each with version (and deleted) and value
+  kMsgQuorumCall = 6, // id, version, key
+  kMsgQuorumAck = 7,  // id, version (and deleted), key, value
+  kMsgTree = 8,       // nodes, hashes (hash tree nodes of the sender)
+  kMsgBatch = 9,      // parts, each a length prefixed datagram of another type
+  kMsgChunk = 10,     // id, seq, total, payload (the rest of the datagram)
+  kMsgChunkAck = 11,  // id, seq (every chunk below it arrived), sacks
+  kMsgPing = 12,      // id, version (incarnation of the sender), members
+  kMsgPingReq = 13,   // id, version, target, members
+  kMsgPingAck = 14,   // id, version, members
+  kMsgRumorBatch = 15, // updates, version 0 for puts forwarded to a replica
+  kMsgQuorumBatchCall = 16, // id, state (versions the requester holds)
+  kMsgQuorumBatchAck = 17   // id, updates
+};
+
+// what the ack of a rumor tells its sender
+enum RumorAck
+{
+  kAckKnown = 0,     // the peer had that version or a newer one already
+  kAckFresh = 1,     // the peer took the update
+  kAckNotReplica = 2 // the peer does not hold the key, says nothing about its spread
+};
+
+// what a node believes about a member of the cluster, spread by piggybacking
+// on the failure detector's pings
+struct Gossip
+{
+  QHostAddress host;
+  int port;
+  quint8 state; // MemberState
+  quint32 incarnation;
+};
+
+// what a sampled update carries on its way from the node that put it,
+// id 0 for the updates that are not traced
+struct Trace
+{
+  Trace() : id(0), origin(0), hops(0) {}
+
+  quint64 id;
+  qint64 origin; // ms since the epoch when it was put
+  int hops;      // transfers from the origin to the receiver
+};
+
+// value and version of a key shipped during anti-entropy, a deleted key
+// is shipped as a tombstone without value
+struct Update
+{
+  Update() : version(0), deleted(false) {}
+
+  int version;
+  QString value;
+  bool deleted;
+  Trace trace;
+};
+
+typedef QMap<QString, int> VersionMap;
+typedef QMap<QString, Update> UpdateMap;
+
+class Message
+{
+  public:
+    Message();
+    Message(quint8 type);
+    QByteArray encode() const;
+    bool decode(const char *data, int size);
+
+    quint8 type;
+    int ack;
+    quint32 id; // request id of a quorum call echoed by its acks, or a transfer id
+    int version;
+    QString key;
+    QString value;
+    bool deleted;       // the rumor is a tombstone of key
+    Trace trace;        // of a rumor, acks echo the id only
+    VersionMap state;   // versions the sender holds
+    VersionMap wanted;  // versions the receiver should send back with values
+    UpdateMap updates;  // keys shipped with their values
+    QVector<quint32> nodes;
+    QVector<quint64> hashes;
+    QList<QByteArray> parts;
+
+    // one piece of a datagram too big to send whole, seq is also the last
+    // change of the sender a delta state covers
+    quint64 seq;
+    quint32 total;
+    QByteArray payload;
+    QVector<quint32> sacks; // chunks received past seq
+
+    QList<Gossip> members;
+    Gossip target; // the member a ping request asks to probe
+
+    // sender of the datagram, taken from the socket and never sent
+    QHostAddress host;
+    int port;
+
+    static const quint8 kWireVersion = 9;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include <QElapsedTimer>
+
+#include "metrics.hh"
+
+Histogram::Histogram()
+{
+  for (int i = 0; i < kBuckets; ++i) {
+    buckets[i].store(0);
+  }
+  total.store(0);
+  valueSum.store(0);
+  highest.store(0);
+}
+
+// bucket i < kSubBuckets holds value i, above that every power of two
+// 2^msb gets kSubBuckets buckets told apart by the bits below the msb
+int Histogram::bucketOf(quint64 value)
+{
+  if (value < kSubBuckets) {
+    return (int)value;
+  }
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - kSubBits;
+  return (shift + 1) * kSubBuckets + (int)((value >> shift) & (kSubBuckets - 1));
+}
+
+quint64 Histogram::highestIn(int bucket)
+{
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  int shift = bucket / kSubBuckets - 1;
+  quint64 lowest = (quint64)(kSubBuckets + bucket % kSubBuckets) << shift;
+  return lowest + ((quint64)1 << shift) - 1;
+}
+
+void Histogram::record(quint64 value)
+{
+  buckets[bucketOf(value)].fetchAndAddRelaxed(1);
+  total.fetchAndAddRelaxed(1);
+  valueSum.fetchAndAddRelaxed(value);
+  quint64 seen = highest.load();
+  while (value > seen and !highest.testAndSetRelaxed(seen, value)) {
+    seen = highest.load();
+  }
+}
+
+quint64 Histogram::count() const
+{
+  return total.load();
+}
+
+quint64 Histogram::sum() const
+{
+  return valueSum.load();
+}
+
+quint64 Histogram::max() const
+{
+  return highest.load();
+}
+
+// the value at or below which a fraction p of the recorded values lie
+quint64 Histogram::percentile(double p) const
+{
+  quint64 n = total.load();
+  if (n == 0) {
+    return 0;
+  }
+  quint64 rank = qMax((quint64)1, (quint64)(p * n + 0.5));
+  quint64 seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets[i].load();
+    if (seen >= rank) {
+      return qMin(highestIn(i), max());
+    }
+  }
+  return max();
+}
+
+// the one set of metrics of the process
+Metrics *Metrics::global()
+{
+  static Metrics metrics;
+  return &metrics;
+}
+
+static QElapsedTimer *startedTimer()
+{
+  QElapsedTimer *timer = new QElapsedTimer();
+  timer->start();
+  return timer;
+}
+
+// microseconds on a monotonic clock, only differences mean anything
+qint64 Metrics::micros()
+{
+  static QElapsedTimer *timer = startedTimer();
+  return timer->nsecsElapsed() / 1000;
+}
+
+void Metrics::messageSent(quint8 type, int bytes)
+{
+  if (type < kMessageTypes) {
+    messagesSent[type].add();
+    messageBytesSent[type].add(bytes);
+  }
+}
+
+void Metrics::messageReceived(quint8 type)
+{
+  if (type < kMessageTypes) {
+    messagesReceived[type].add();
+  }
+}
+
+// label values of the message types, indexed by MessageType
+static const char *typeNames[] = {
+  "none", "rumor", "ack", "state", "state_reply", "updates", "quorum_call",
+  "quorum_ack", "tree", "batch", "chunk", "chunk_ack", "ping", "ping_req",
+  "ping_ack", "rumor_batch", "quorum_batch_call", "quorum_batch_ack"
+};
+
+static void counter(QString &out, const char *name, const Counter &c)
+{
+  out += QString("%1 %2\n").arg(name).arg(c.get());
+}
+
+static void gauge(QString &out, const char *name, const Gauge &g)
+{
+  out += QString("%1 %2\n").arg(name).arg(g.get());
+}
+
+// per type counters, types never seen are left out
+static void perType(QString &out, const char *name, const Counter *counters, int size)
+{
+  int named = sizeof(typeNames) / sizeof(typeNames[0]);
+  for (int i = 0; i < size; ++i) {
+    if (counters[i].get() == 0) {
+      continue;
+    }
+    QString type = i < named ? QString(typeNames[i]) : QString::number(i);
+    out += QString("%1{type=\"%2\"} %3\n").arg(name).arg(type).arg(counters[i].get());
+  }
+}
+
+// a histogram as a summary: a few quantiles, the sum and the count
+static void summary(QString &out, const char *name, const Histogram &h)
+{
+  static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  for (unsigned i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+    out += QString("%1{quantile=\"%2\"} %3\n").arg(name).arg(quantiles[i]).arg(h.percentile(quantiles[i]));
+  }
+  out += QString("%1_max %2\n").arg(name).arg(h.max());
+  out += QString("%1_sum %2\n").arg(name).arg(h.sum());
+  out += QString("%1_count %2\n").arg(name).arg(h.count());
+}
+
+QString Metrics::text() const
+{
+  QString out;
+  counter(out, "datagrams_sent", datagramsSent);
+  counter(out, "bytes_sent", bytesSent);
+  counter(out, "datagrams_received", datagramsReceived);
+  counter(out, "bytes_received", bytesReceived);
+  counter(out, "datagrams_dropped", datagramsDropped);
+  counter(out, "decode_errors", decodeErrors);
+  perType(out, "messages_sent", messagesSent, kMessageTypes);
+  perType(out, "message_bytes_sent", messageBytesSent, kMessageTypes);
+  perType(out, "messages_received", messagesReceived, kMessageTypes);
+  gauge(out, "send_queue", sendQueue);
+
+  counter(out, "rumors_created", rumorsCreated);
+  counter(out, "rumors_acked", rumorsAcked);
+  counter(out, "rumors_eliminated", rumorsEliminated);
+
+  counter(out, "quorums_decided", quorumsDecided);
+  counter(out, "quorums_unanimous", quorumsUnanimous);
+  counter(out, "quorums_timed_out", quorumsTimedOut);
+  counter(out, "read_repairs", readRepairs);
+  counter(out, "lease_reads", leaseReads);
+  summary(out, "quorum_latency_us", quorumLatency);
+
+  summary(out, "anti_entropy_divergence", divergence);
+
+  summary(out, "store_read_us", storeRead);
+  summary(out, "store_write_us", storeWrite);
+  summary(out, "store_sync_us", storeSync);
+  gauge(out, "store_queue", storeQueue);
+  counter(out, "cache_hits", cacheHits);
+  counter(out, "cache_misses", cacheMisses);
+  gauge(out, "cache_bytes", cacheBytes);
+  return out;
+}
@@ -0,0 +1,109 @@
+#ifndef METRICS_CLASS_HH
+#define METRICS_CLASS_HH
+
+#include <QAtomicInteger>
+#include <QString>
+
+// a count that only goes up, bumped from any thread without a lock
+class Counter
+{
+  public:
+    Counter() : value(0) {}
+    void add(quint64 n = 1) { value.fetchAndAddRelaxed(n); }
+    quint64 get() const { return value.load(); }
+
+  private:
+    QAtomicInteger<quint64> value;
+};
+
+// a level that goes up and down, like the depth of a queue
+class Gauge
+{
+  public:
+    Gauge() : value(0) {}
+    void set(qint64 level) { value.store(level); }
+    qint64 get() const { return value.load(); }
+
+  private:
+    QAtomicInteger<qint64> value;
+};
+
+// Distribution of values in log-linear buckets, like an HDR histogram with
+// kSubBits bits of precision: values below 2^kSubBits get a bucket each,
+// every power of two above is split into 2^kSubBits buckets, so a reported
+// percentile is at most 1/2^kSubBits above the true one. Recording is a
+// few relaxed atomic adds, safe from any thread.
+class Histogram
+{
+  public:
+    Histogram();
+    void record(quint64 value);
+    quint64 count() const;
+    quint64 sum() const;
+    quint64 max() const;
+    quint64 percentile(double p) const;
+
+  private:
+    static int bucketOf(quint64 value);
+    static quint64 highestIn(int bucket);
+
+    enum { kSubBits = 3, kSubBuckets = 1 << kSubBits, kBuckets = (65 - kSubBits) * kSubBuckets };
+    QAtomicInteger<quint64> buckets[kBuckets];
+    QAtomicInteger<quint64> total, valueSum, highest;
+};
+
+// The metrics of this process, shared by every thread that feeds them.
+// text() renders them in the Prometheus text format, one line of name and
+// value each, which is what the client stats request and the metrics file
+// of a node carry. Latencies are in microseconds of micros().
+class Metrics
+{
+  public:
+    static Metrics *global();
+    static qint64 micros();
+    QString text() const;
+
+    enum { kMessageTypes = 32 }; // above every MessageType
+    void messageSent(quint8 type, int bytes);
+    void messageReceived(quint8 type);
+
+    // network, counted at the socket
+    Counter datagramsSent, bytesSent, datagramsReceived, bytesReceived;
+    Counter datagramsDropped, decodeErrors;
+    Gauge sendQueue;           // datagrams waiting for the socket
+
+    // rumor mongering
+    Counter rumorsCreated, rumorsAcked, rumorsEliminated;
+
+    // quorum reads
+    Counter quorumsDecided, quorumsUnanimous, quorumsTimedOut;
+    Counter readRepairs, leaseReads;
+    Histogram quorumLatency;
+
+    // anti-entropy
+    Histogram divergence;      // keys found out of sync per round
+
+    // storage
+    Histogram storeRead, storeWrite, storeSync;
+    Gauge storeQueue;          // puts waiting for the io thread
+    Counter cacheHits, cacheMisses; // reads of the log store answered by its value cache or not
+    Gauge cacheBytes;          // held by the value cache
+
+  private:
+    Counter messagesSent[kMessageTypes], messageBytesSent[kMessageTypes];
+    Counter messagesReceived[kMessageTypes];
+};
+
+// records the microseconds from its construction to the end of its scope
+class ScopedLatency
+{
+  public:
+    ScopedLatency(Histogram &histogram) : histogram(histogram), start(Metrics::micros()) {}
+    ~ScopedLatency() { histogram.record(Metrics::micros() - start); }
+
+  private:
+    Histogram &histogram;
+    qint64 start;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef MPSCQUEUE_CLASS_HH
+#define MPSCQUEUE_CLASS_HH
+
+#include <QAtomicPointer>
+
+// Unbounded lock-free queue of T pointers, any number of threads may push,
+// exactly one thread may pop (Vyukov's intrusive mpsc list). A pop that
+// races with an unfinished push returns 0, the pushing thread has to wake
+// the consumer again once its push is done.
+template <class T>
+class MpscQueue
+{
+  public:
+    MpscQueue()
+    {
+      stub.next.store(0);
+      stub.item = 0;
+      head.store(&stub);
+      tail = &stub;
+    }
+
+    ~MpscQueue()
+    {
+      T *item;
+      while ((item = pop())) {
+        delete item;
+      }
+    }
+
+    void push(T *item)
+    {
+      Link *n = new Link;
+      n->item = item;
+      n->next.store(0);
+      append(n);
+    }
+
+    // oldest item, 0 if there is none
+    T *pop()
+    {
+      Link *t = tail;
+      Link *next = t->next.loadAcquire();
+      if (t == &stub) {
+        if (!next) {
+          return 0;
+        }
+        tail = next;
+        t = next;
+        next = next->next.loadAcquire();
+      }
+      if (!next) {
+        if (t != head.loadAcquire()) {
+          return 0;
+        }
+        // t is the last link, put the stub behind it so it can be handed out
+        stub.next.store(0);
+        append(&stub);
+        next = t->next.loadAcquire();
+        if (!next) {
+          return 0;
+        }
+      }
+      tail = next;
+      T *item = t->item;
+      delete t;
+      return item;
+    }
+
+  private:
+    struct Link
+    {
+      QAtomicPointer<Link> next;
+      T *item;
+    };
+
+    void append(Link *n)
+    {
+      Link *prev = head.fetchAndStoreOrdered(n);
+      prev->next.storeRelease(n);
+    }
+
+    QAtomicPointer<Link> head; // last pushed, producers swap themselves in here
+    Link *tail;                // next to pop, only touched by the consumer
+    Link stub;
+};
+
+#endif
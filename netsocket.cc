@@ -1,6 +1,7 @@
 #include <unistd.h>
 
 #include "netsocket.hh"
+#include "metrics.hh"
 
 NetSocket::NetSocket()
 {
@@ -13,11 +14,52 @@ NetSocket::NetSocket()
 	// We use the range from 32768 to 49151 for this purpose.
 	myPortMin = 32768 + (getuid() % 4096)*4;
 	myPortMax = myPortMin + 3;
-  kRumorProb = 2; // 1/kRumorProb is probability rumors stop when encountering infected node
+
+  // everything sent during one pass of the event loop leaves in one flush
+  outbox = new QHash<Peer, QList<QByteArray> >();
+  kMaxDatagram = 1400; // fits an ethernet MTU with the IP and UDP headers
+  flushTimer = new QTimer(this);
+  flushTimer->setSingleShot(true);
+  connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+  queued = 0;
+  saturated = false;
+  backoff = 0;
+  kMaxQueue = 1024;
+  kHighWater = 2048;
+  kLowWater = 512;
+  // one busy peer fills its queue long before all of them reach kHighWater,
+  // the sender has to hear about it before kMaxQueue drops datagrams
+  kPeerHighWater = 768;
+  kPeerLowWater = 256;
+  kMinBackoff = 5;
+  kMaxBackoff = 1000;
+  kRate = 32 * 1024 * 1024; // bytes per second
+  kBurst = 256 * 1024;
+  tokens = kBurst;
+  clock.start();
+  lastRefill = 0;
+  pumpTimer = new QTimer(this);
+  pumpTimer->setSingleShot(true);
+  connect(pumpTimer, SIGNAL(timeout()), this, SLOT(pump()));
+
+  streamer = new Streamer(this);
+  streamer->setParent(this);
 }
 
-bool NetSocket::bind()
+bool NetSocket::bind(int port)
 {
+  if (port > 0) {
+    if (!QUdpSocket::bind(port)) {
+      qWarning() << "could not bind to UDP port " << port;
+      return false;
+    }
+    boundPort = port;
+    address = QHostAddress(QHostAddress::LocalHost);
+    qDebug() << "bound to UDP port " << port;
+    return true;
+  }
+
 	// Try to bind to each of the range myPortMin..myPortMax in turn.
 	for (int p = myPortMin; p <= myPortMax; p++) {
 		if (QUdpSocket::bind(p)) {
@@ -28,74 +70,190 @@ bool NetSocket::bind()
 		}
 	}
 
-	qDebug() << "Oops, no ports in my default range " << myPortMin
+	qWarning() << "Oops, no ports in my default range " << myPortMin
 		<< "-" << myPortMax << " available";
 	return false;
 }
 
-void NetSocket::findNeighbors()
+// the other default ports of this host, the cluster when no seeds are given
+QList<Peer> NetSocket::defaultPeers() const
 {
-  neighbors = new QVector<QPair<QHostAddress, int> >();
+  QList<Peer> peers;
   for (int p = myPortMin; p <= myPortMax; p++) {
     if (boundPort != p) {
       // running on zoo machines, so our neighbors are all on localhost
-      neighbors->append(qMakePair(QHostAddress(QHostAddress::LocalHost), p));
+      peers.append(qMakePair(QHostAddress(QHostAddress::LocalHost), p));
     }
   }
+  return peers;
+}
+
+QByteArray NetSocket::serialize(const Message &msg)
+{
+  return msg.encode();
+}
+
+Peer NetSocket::self() const
+{
+  return qMakePair(address, boundPort);
+}
+
+void NetSocket::send(const Message &msg, const Peer &peer)
+{
+  sendResponseMessage(msg, peer.first, peer.second);
+}
+
+bool NetSocket::receiveChunk(const Message &chunk, QByteArray &datagram)
+{
+  return streamer->receiveChunk(chunk, datagram);
+}
+
+void NetSocket::receiveChunkAck(const Message &ack)
+{
+  streamer->receiveAck(ack);
+}
+
+// queues message for host and port, it is sent with the next flush
+void NetSocket::sendResponseMessage(const Message &msg, QHostAddress host, int port)
+{
+  QByteArray encoded = serialize(msg);
+  Metrics::global()->messageSent(msg.type, encoded.size());
+  (*outbox)[qMakePair(host, port)].append(encoded);
+  if (!flushTimer->isActive()) {
+    flushTimer->start(0);
+  }
+}
+
+// queues datagram for host and port, it is dropped if that peer's queue is full
+void NetSocket::sendDatagram(const QByteArray &datagram, QHostAddress host, int port)
+{
+  Peer peer = qMakePair(host, port);
+  QQueue<QByteArray> &q = sendQueues[peer];
+  if (q.size() >= kMaxQueue) {
+    Metrics::global()->datagramsDropped.add();
+    return;
+  }
+
+  if (q.isEmpty()) {
+    ready.append(peer);
+  }
+  q.enqueue(datagram);
+  Metrics::global()->sendQueue.set(++queued);
+  if (q.size() >= kPeerHighWater) {
+    backedUp.insert(peer);
+  }
+  updateCongestion();
+  if (!pumpTimer->isActive()) {
+    pumpTimer->start(0);
+  }
 }
 
-QByteArray* NetSocket::serialize(QVariantMap msg)
+// true while the send queues are backed up, low priority traffic should wait
+bool NetSocket::congested() const
 {
-  QByteArray *serialized = new QByteArray();
-  QDataStream out(serialized, QIODevice::OpenMode(QIODevice::ReadWrite));
-  out << msg;
-  return serialized;
+  return saturated;
 }
 
-// writes datagram with message, host, and port
-void NetSocket::sendResponseMessage(QVariantMap msg, QHostAddress host, int port)
+// signals congestion when all queues together or the queue of any one peer
+// fill up, and its end once they have drained
+void NetSocket::updateCongestion()
 {
-  QByteArray *serialized = serialize(msg);
-  if (QUdpSocket::writeDatagram(serialized->data(), serialized->size(), host, port) == -1) {
-    qDebug() << "failed to send";
-    sleep(1000);
-    sendResponseMessage(msg, host, port);
+  bool now = !backedUp.isEmpty() or queued >= kHighWater or (saturated and queued > kLowWater);
+  if (now != saturated) {
+    saturated = now;
+    emit congestion(now);
   }
 }
 
-// sends the specified rumor to a random neighboring node
-void NetSocket::sendRandomMessage(QVariantMap msg)
+void NetSocket::refill()
 {
-  QPair<QHostAddress, int> neighbor = neighbors->at(rand() % neighbors->size()); 
-  qDebug() << "Sending message to port " << neighbor.second;
-  
-  sendResponseMessage(msg, neighbor.first, neighbor.second); 
+  qint64 now = clock.elapsed();
+  tokens = qMin(kBurst, tokens + (now - lastRefill) * kRate / 1000);
+  lastRefill = now;
 }
 
-// sends acknowledgement of rumor
-void NetSocket::sendAck(int ack, QVariantMap msg)
+// writes queued datagrams, one per peer in turn, while there are tokens
+// left, then sleeps on the timer until more tokens or a retry are due
+void NetSocket::pump()
 {
-  // create message
-  QVariantMap ackmsg;
-  ackmsg.insert(QString("Ack"), ack);
-  ackmsg.insert(QString("Key"), msg[QString("Key")].toString());
-  ackmsg.insert(QString("Version"), msg[QString("Version")].toInt());
+  refill();
+  while (!ready.isEmpty()) {
+    Peer peer = ready.first();
+    QQueue<QByteArray> &q = sendQueues[peer];
+    const QByteArray &datagram = q.head();
+    if (tokens < datagram.size()) {
+      pumpTimer->start(qMax(1, (int)((datagram.size() - tokens) * 1000 / kRate)));
+      break;
+    }
 
-  qDebug() << "Sending ack to port " << msg[QString("Port")].toInt();
-  
-  sendResponseMessage(ackmsg, QHostAddress(msg[QString("Host")].toString()), msg[QString("Port")].toInt());
+    if (QUdpSocket::writeDatagram(datagram.constData(), datagram.size(), peer.first, peer.second) == -1) {
+      if (error() != QAbstractSocket::DatagramTooLargeError) {
+        // most likely ENOBUFS, the kernel buffers drain by themselves
+        backoff = backoff ? qMin(kMaxBackoff, backoff * 2) : kMinBackoff;
+        qWarning() << "failed to send: " << errorString() << ", retrying in " << backoff << " ms";
+        pumpTimer->start(backoff);
+        break;
+      }
+      qWarning() << "dropping datagram of " << datagram.size() << " bytes, too large";
+      Metrics::global()->datagramsDropped.add();
+    } else {
+      tokens -= datagram.size();
+      backoff = 0;
+      Metrics::global()->datagramsSent.add();
+      Metrics::global()->bytesSent.add(datagram.size());
+    }
+
+    q.dequeue();
+    Metrics::global()->sendQueue.set(--queued);
+    ready.removeFirst();
+    if (q.size() <= kPeerLowWater) {
+      backedUp.remove(peer);
+    }
+    if (q.isEmpty()) {
+      sendQueues.remove(peer);
+    } else {
+      ready.append(peer);
+    }
+  }
+
+  updateCongestion();
 }
 
-// deserialize a datagram into a QVariantMap msg
-QVariantMap NetSocket::deserialize()
+// sends the parts of batch, unwrapped if there is only one
+void NetSocket::sendBatch(const Message &batch, const Peer &peer)
 {
-  QByteArray *deserialized = new QByteArray();
-  int size = pendingDatagramSize();
-  deserialized->resize(size);
-  readDatagram(deserialized->data(), size);
+  if (batch.parts.size() == 1) {
+    sendDatagram(batch.parts.at(0), peer.first, peer.second);
+  } else if (batch.parts.size() > 1) {
+    sendDatagram(batch.encode(), peer.first, peer.second);
+  }
+}
+
+// packs the queued messages of every peer into as few datagrams as fit in
+// kMaxDatagram, messages bigger than that are streamed in chunks
+void NetSocket::flush()
+{
+  QHash<Peer, QList<QByteArray> > pending = *outbox;
+  outbox->clear();
 
-  QDataStream in(deserialized, QIODevice::OpenMode(QIODevice::ReadOnly));
-  QVariantMap msg;
-  in >> msg;
-  return msg;
+  for (QHash<Peer, QList<QByteArray> >::const_iterator i = pending.begin(); i != pending.end(); ++i) {
+    Message batch(kMsgBatch);
+    int size = 2;
+    for (int j = 0; j < i.value().size(); ++j) {
+      // a part costs its length varint, at most 3 bytes here, on top of itself
+      const QByteArray &msg = i.value().at(j);
+      if (2 + 3 + msg.size() > kMaxDatagram) {
+        streamer->send(msg, i.key());
+        continue;
+      }
+      if (size + 3 + msg.size() > kMaxDatagram) {
+        sendBatch(batch, i.key());
+        batch.parts.clear();
+        size = 2;
+      }
+      batch.parts.append(msg);
+      size += 3 + msg.size();
+    }
+    sendBatch(batch, i.key());
+  }
 }
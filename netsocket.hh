@@ -2,32 +2,75 @@
 #define NETSOCKET_CLASS_HH
 
 #include <QUdpSocket>
-#include <QVariantMap>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QQueue>
+#include <QSet>
+#include <QTimer>
 
-class NetSocket : public QUdpSocket
+#include "message.hh"
+#include "streamer.hh"
+#include "transport.hh"
+
+class NetSocket : public QUdpSocket, public Transport
 {
   Q_OBJECT
 
   public:
     NetSocket();
-    bool bind(); // Bind this socket to a Peerster-specific default port.
-    void findNeighbors();
-    QByteArray* serialize(QVariantMap);
-    QVariantMap deserialize();
-    void sendAck(int ack, QVariantMap msg);
-    void sendResponseMessage(QVariantMap, QHostAddress, int);
-
-    int boundPort, kRumorProb; // const kRumorProb?
+    bool bind(int port = 0); // Bind to port, or to a Peerster-specific default port if 0.
+    QList<Peer> defaultPeers() const;
+    QByteArray serialize(const Message &);
+    void sendResponseMessage(const Message &, QHostAddress, int);
+    void sendDatagram(const QByteArray &, QHostAddress, int);
+    void sendBatch(const Message &batch, const Peer &peer);
+
+    Peer self() const;
+    void send(const Message &msg, const Peer &peer);
+    bool congested() const;
+    bool receiveChunk(const Message &chunk, QByteArray &datagram);
+    void receiveChunkAck(const Message &ack);
+
+    int boundPort;
     QHostAddress address;
-    QString dir_name;
 
-    QVector<QPair<QHostAddress, int> > *neighbors; // vector of <address, port> pairs
+    Streamer *streamer;       // carries messages bigger than a datagram
 
   public slots:
-    void sendRandomMessage(QVariantMap msg);
+    void flush();
+    void pump();
+
+  signals:
+    // the send queues crossed kHighWater going up, or kLowWater going down,
+    // or the queue of one peer crossed kPeerHighWater or kPeerLowWater
+    void congestion(bool);
 
   private:
+    void refill();
+    void updateCongestion();
+
     int myPortMin, myPortMax;
+
+    // encoded messages waiting for the next flush, packed per peer
+    QHash<Peer, QList<QByteArray> > *outbox;
+    QTimer *flushTimer;
+    int kMaxDatagram;
+
+    // Datagrams waiting for the socket, at most kMaxQueue per peer, sent
+    // round robin as a token bucket of kRate bytes per second allows. A
+    // failed write stays at the head and is retried after a backoff.
+    QHash<Peer, QQueue<QByteArray> > sendQueues;
+    QList<Peer> ready; // peers with queued datagrams, in round robin order
+    int queued;        // datagrams in all of sendQueues
+    QSet<Peer> backedUp; // peers whose queue passed kPeerHighWater and not yet kPeerLowWater
+    bool saturated;
+    QTimer *pumpTimer;
+    QElapsedTimer clock;
+    double tokens;
+    qint64 lastRefill;
+    int backoff;       // ms until the next retry of a failed write, 0 if none
+    int kMaxQueue, kHighWater, kLowWater, kPeerHighWater, kPeerLowWater, kMinBackoff, kMaxBackoff;
+    double kRate, kBurst;
 };
 
 #endif
@@ -0,0 +1,1046 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+
+#include <QDebug>
+#include <QSaveFile>
+
+#include "node.hh"
+#include "logstore.hh"
+#include "netsocket.hh"
+#include "metrics.hh"
+
+// remove rumor with key if it exists
+void Node::eliminateRumorByKey(QString key)
+{
+  hotRumors->remove(key);
+}
+
+// attaches ack message to proper rumor, a peer that does not hold the key
+// neither stops the rumor nor counts as a duplicate
+void Node::attachAckMessage(const Message &msg)
+{
+  if (msg.ack == kAckNotReplica) {
+    return;
+  }
+  gossip->ackSeen(msg.ack);
+  hotRumors->attachAck(msg);
+  if (msg.trace.id) {
+    tracer->record(msg.ack == kAckFresh ? kTraceAcked : kTraceKnown, msg.key, msg.version, msg.trace,
+                   qMakePair(msg.host, msg.port));
+  }
+}
+
+// updates versioning and writes key/value pair if necessary, returns a
+// RumorAck, path tells the tracer how the update got here
+int Node::processRumor(Message msg, TraceEvent path)
+{
+  QString key = msg.key;
+  int new_version = msg.version;
+  if (new_version == 0) {
+    // a put forwarded by a node that does not hold the key, we pick the version
+    putLocal(key, msg.value, msg.deleted);
+    return kAckFresh;
+  }
+  if (!owns(key)) {
+    // not ours to keep, the sender should try the key's replicas
+    return kAckNotReplica;
+  }
+  Update u;
+  u.version = new_version;
+  u.value = msg.value;
+  u.deleted = msg.deleted;
+  if (applyUpdate(key, u)) {
+    if (msg.trace.id) {
+      tracer->record(path, key, new_version, msg.trace, qMakePair(msg.host, msg.port));
+    }
+    // replaces the rumor of any older version
+    msg.type = kMsgRumor;
+    hotRumors->add(msg);
+    return kAckFresh;
+  } else {
+    if (msg.trace.id and path == kTraceRumor) {
+      tracer->record(kTraceDuplicate, key, new_version, msg.trace, qMakePair(msg.host, msg.port));
+    }
+    return kAckKnown;
+  }
+}
+
+// records u as the newest version of key and stores it, returns false if
+// key already has that version or a newer one
+bool Node::applyUpdate(const QString &key, const Update &u)
+{
+  if (vt->findVersion(key) >= u.version) {
+    return false;
+  }
+  vt->setVersion(key, u.version);
+  if (u.deleted) {
+    store->remove(key, u.version);
+    death->bury(key, u.version, vt->versions->lastSeq());
+  } else {
+    store->put(key, u.version, u.value);
+    death->revive(key);
+  }
+  return true;
+}
+
+// applies a batch of rumors, the puts in it that were forwarded without a
+// version are written here as one batch and acked one by one
+void Node::processRumorBatch(const Message &msg)
+{
+  UpdateMap forwarded;
+  for (UpdateMap::const_iterator i = msg.updates.begin(); i != msg.updates.end(); ++i) {
+    if (i.value().version == 0) {
+      forwarded.insert(i.key(), i.value());
+    } else if (owns(i.key()) and applyUpdate(i.key(), i.value()) and i.value().trace.id) {
+      tracer->record(kTraceBatch, i.key(), i.value().version, i.value().trace,
+                     qMakePair(msg.host, msg.port));
+    }
+  }
+  if (forwarded.isEmpty()) {
+    return;
+  }
+
+  writeBatch(forwarded, true);
+  for (UpdateMap::const_iterator i = forwarded.begin(); i != forwarded.end(); ++i) {
+    Message put(kMsgRumor);
+    put.key = i.key();
+    put.version = 0;
+    put.host = msg.host;
+    put.port = msg.port;
+    acknowledge(kAckFresh, put);
+  }
+}
+
+// Writes a batch of keys. The keys this node holds, or all of them if the
+// batch was forwarded here, get their next version and go on to their
+// other replicas, the others go to their primary replica, in one rumor
+// batch per peer either way. The versioned updates are not resent, the
+// next delta anti-entropy round between the replicas repairs whatever got
+// lost. Nothing holds the forwarded puts yet, so each is also kept as a hot
+// rumor and resent to the primary until the primary acks it.
+void Node::writeBatch(const UpdateMap &batch, bool forwarded)
+{
+  QHash<Peer, Message> out;
+  for (UpdateMap::const_iterator i = batch.begin(); i != batch.end(); ++i) {
+    QList<Peer> replicas = ring->replicas(i.key());
+    Update u = i.value();
+    if (!forwarded and !replicas.contains(self)) {
+      u.version = 0;
+      out[replicas.first()].updates.insert(i.key(), u);
+      Message put(kMsgRumor);
+      put.key = i.key();
+      put.value = u.value;
+      put.deleted = u.deleted;
+      put.version = 0;
+      hotRumors->add(put);
+      continue;
+    }
+
+    u.version = nextVersion(i.key());
+    u.trace = tracer->start();
+    applyUpdate(i.key(), u);
+    if (u.trace.id) {
+      tracer->record(kTracePut, i.key(), u.version, u.trace);
+      ++u.trace.hops;
+    }
+    for (int j = 0; j < replicas.size(); ++j) {
+      if (replicas.at(j) != self) {
+        out[replicas.at(j)].updates.insert(i.key(), u);
+      }
+    }
+  }
+
+  for (QHash<Peer, Message>::iterator p = out.begin(); p != out.end(); ++p) {
+    p.value().type = kMsgRumorBatch;
+    transport->send(p.value(), p.key());
+  }
+}
+
+// place updates anti-entropy brought from peer into storage
+void Node::placeUpdates(const UpdateMap &updates, const Peer &from)
+{
+  for (UpdateMap::const_iterator i = updates.begin(); i != updates.end(); ++i) {
+    Message msg(kMsgRumor);
+    msg.key = i.key();
+    msg.value = i.value().value;
+    msg.version = i.value().version;
+    msg.deleted = i.value().deleted;
+    msg.trace = i.value().trace;
+    msg.host = from.first;
+    msg.port = from.second;
+    processRumor(msg, kTraceEntropy);
+  }
+}
+
+// applies the messages decoded by the receive pipeline, this is the only
+// thread that touches the node state
+void Node::drainInbox()
+{
+  inbox->rearm();
+  Message *msg;
+  while ((msg = inbox->pop())) {
+    processMessage(*msg);
+    delete(msg);
+  }
+}
+
+// dispatches one received message
+void Node::processMessage(const Message &msg)
+{
+  Metrics::global()->messageReceived(msg.type);
+  switch (msg.type) {
+    case kMsgRumor: {
+      int ack = processRumor(msg);
+      acknowledge(ack, msg);
+      break;
+    }
+    case kMsgAck:
+      attachAckMessage(msg);
+      break;
+    case kMsgState:
+    case kMsgStateReply:
+      processEntropy(msg);
+      break;
+    case kMsgUpdates:
+      placeUpdates(msg.updates, qMakePair(msg.host, msg.port));
+      break;
+    case kMsgTree:
+      processTree(msg);
+      break;
+    case kMsgQuorumCall:
+      sendQuorumResponse(msg);
+      break;
+    case kMsgQuorumAck:
+      processQuorumResponse(msg);
+      break;
+    case kMsgRumorBatch:
+      processRumorBatch(msg);
+      break;
+    case kMsgQuorumBatchCall:
+      sendBatchQuorumResponse(msg);
+      break;
+    case kMsgQuorumBatchAck:
+      quorums->processBatchResponse(msg);
+      break;
+    case kMsgChunk: {
+      QByteArray datagram;
+      Message whole;
+      if (transport->receiveChunk(msg, datagram) and
+          whole.decode(datagram.constData(), datagram.size()) and whole.type != kMsgChunk) {
+        whole.host = msg.host;
+        whole.port = msg.port;
+        processMessage(whole);
+      }
+      break;
+    }
+    case kMsgChunkAck:
+      transport->receiveChunkAck(msg);
+      break;
+    case kMsgPing:
+    case kMsgPingReq:
+    case kMsgPingAck:
+      membership->processMessage(msg);
+      break;
+    case kMsgBatch:
+      for (int i = 0; i < msg.parts.size(); ++i) {
+        Message part;
+        if (part.decode(msg.parts.at(i).constData(), msg.parts.at(i).size()) and
+            part.type != kMsgBatch) {
+          part.host = msg.host;
+          part.port = msg.port;
+          processMessage(part);
+        }
+      }
+      break;
+    default:
+      // malformed or from a newer wire version
+      break;
+  }
+}
+
+// checks new state for required updates, returns required update list
+VersionMap Node::findRequiredUpdates(const VersionMap &newstate, const VersionMap &oldstate)
+{
+  VersionMap updates;
+  for (VersionMap::const_iterator i = newstate.begin(); i != newstate.end(); ++i) {
+    VersionMap::const_iterator old = oldstate.find(i.key());
+    if (old != oldstate.end()) {
+      if (old.value() < i.value()) {
+        updates.insert(i.key(), i.value());
+      }
+    } else {
+      // new key here
+      updates.insert(i.key(), i.value());
+    }
+  }
+  return updates;
+}
+
+// seeks values from database and attaches them to the versions
+UpdateMap Node::attachValuesToUpdates(const VersionMap &updates)
+{
+  UpdateMap updatesWithValues;
+  for (VersionMap::const_iterator i = updates.begin(); i != updates.end(); ++i) {
+    Update u;
+    u.version = i.value();
+    u.deleted = death->isDead(i.key());
+    if (!u.deleted) {
+      u.value = store->get(i.key());
+    }
+    u.trace = tracer->forward(i.key(), u.version);
+    updatesWithValues.insert(i.key(), u);
+  }
+  return updatesWithValues;
+}
+
+// processes an anti-entropy message
+void Node::processEntropy(const Message &msg)
+{
+  if (msg.type == kMsgStateReply) {
+    gossip->divergence(msg.wanted.size() + msg.updates.size());
+    if (!msg.wanted.isEmpty()) {
+      Message updatemsg(kMsgUpdates);
+      updatemsg.updates = attachValuesToUpdates(msg.wanted);
+      transport->send(updatemsg, qMakePair(msg.host, msg.port));
+    }
+
+    placeUpdates(msg.updates, qMakePair(msg.host, msg.port));
+
+    if (msg.seq and msg.wanted.isEmpty()) {
+      // The peer has our changes up to seq now, carry on with the next
+      // page. While it still wants some of them the watermark stays, the
+      // updates sent above are not acked and may get lost, so the next
+      // round offers the same page again. Tombstones are only collected
+      // past the watermark, so one can't go before every replica has it.
+      Peer peer = qMakePair(msg.host, msg.port);
+      SyncMark &mark = marks[peer];
+      if (msg.seq > mark.acked) {
+        mark.acked = msg.seq;
+        if (msg.seq == mark.cursorSeq and vt->versions->lastSeq() > msg.seq) {
+          sendDelta(peer);
+        }
+      }
+    }
+  } else {
+    // a delta only covers the keys listed, otherwise the state covers the
+    // leaves listed, or everything if none are
+    Peer peer = qMakePair(msg.host, msg.port);
+    VersionMap theirs = shared(msg.state, peer);
+    VersionMap own;
+    if (msg.seq) {
+      for (VersionMap::const_iterator i = theirs.begin(); i != theirs.end(); ++i) {
+        int version = vt->findVersion(i.key());
+        if (version) {
+          own.insert(i.key(), version);
+        }
+      }
+    } else {
+      own = shared(msg.nodes.isEmpty() ? vt->snapshot() : vt->versionsIn(msg.nodes), peer);
+    }
+
+    Message ackmsg(kMsgStateReply);
+    // contains keys that this node needs
+    ackmsg.wanted = findRequiredUpdates(theirs, own);
+    // obtaining <version, value> pairs that the messaging node requires
+    ackmsg.updates = attachValuesToUpdates(findRequiredUpdates(own, theirs));
+    // a delta is always answered, the answer moves the sender's watermark
+    ackmsg.seq = msg.seq;
+    gossip->divergence(ackmsg.wanted.size() + ackmsg.updates.size());
+
+    if (msg.seq or !ackmsg.wanted.isEmpty() or !ackmsg.updates.isEmpty()) {
+      transport->send(ackmsg, qMakePair(msg.host, msg.port));
+    }
+  }
+}
+
+// sends peer the versions of the keys changed since its watermark, at
+// most kMaxDelta of them, nothing if it is up to date
+void Node::sendDelta(const Peer &peer)
+{
+  SyncMark &mark = marks[peer];
+  VersionMap changes = vt->changesAfter(mark.acked, mark.cursor, mark.cursorSeq, kMaxDelta);
+  if (changes.isEmpty()) {
+    return;
+  }
+  // sent even if none of the changes concern peer, its answer moves the watermark
+  Message delta(kMsgState);
+  delta.state = shared(changes, peer);
+  delta.seq = mark.cursorSeq;
+  transport->send(delta, peer);
+}
+
+// compares the sender's tree nodes with ours, answering with the children of
+// the nodes that differ, and with the versions of the leaves that differ
+void Node::processTree(const Message &msg)
+{
+  Message reply(kMsgTree);
+  Message leafState(kMsgState);
+
+  for (int i = 0; i < msg.nodes.size(); ++i) {
+    quint32 node = msg.nodes.at(i);
+    if (!vt->tree->isNode(node) or vt->tree->hash(node) == msg.hashes.at(i)) {
+      continue;
+    }
+
+    if (vt->tree->isLeaf(node)) {
+      leafState.nodes.append(node);
+    } else if (reply.nodes.size() < kMaxTreeNodes) {
+      QList<quint32> children = vt->tree->descendants(node, kTreeStep);
+      for (int j = 0; j < children.size(); ++j) {
+        reply.nodes.append(children.at(j));
+        reply.hashes.append(vt->tree->hash(children.at(j)));
+      }
+    }
+    // subtrees past kMaxTreeNodes are left to the next round
+  }
+
+  if (!reply.nodes.isEmpty()) {
+    transport->send(reply, qMakePair(msg.host, msg.port));
+  }
+  if (!leafState.nodes.isEmpty()) {
+    // a leaf can differ by keys only one of us holds, divergence is counted
+    // by the state exchange, of the shared keys whose versions differ
+    leafState.state = shared(vt->versionsIn(leafState.nodes), qMakePair(msg.host, msg.port));
+    transport->send(leafState, qMakePair(msg.host, msg.port));
+  }
+}
+
+// Runs a round of anti-entropy with a random neighbor. Usually that is a
+// delta of what changed since its watermark, which costs nothing once it
+// is caught up. Every kTreeEvery rounds the roots of the hash trees are
+// compared instead, which repairs whatever deltas missed, like updates
+// lost on the way or a neighbor that lost its data.
+void Node::sendAntiEntropy()
+{
+  clock->after(gossip->nextAntiEntropy(transport->congested()), this, SLOT(sendAntiEntropy()));
+
+  // a round of anti-entropy can wait for the backlog to clear, the next one will catch up
+  if (transport->congested() or membership->neighbors.isEmpty()) {
+    return;
+  }
+
+  Peer peer = membership->neighbors.at(rand() % membership->neighbors.size());
+  if (++antiRound % kTreeEvery != 0) {
+    sendDelta(peer);
+    return;
+  }
+
+  Message msg(kMsgTree);
+  msg.nodes.append(MerkleTree::kRoot);
+  msg.hashes.append(vt->tree->hash(MerkleTree::kRoot));
+  transport->send(msg, peer);
+}
+
+// processes a put request
+void Node::putRequest(QString key, QString value)
+{
+  // invalid put request with empty key
+  if (key.isEmpty()) {
+    return;
+  }
+
+  write(key, value, false);
+}
+
+// writes key here if this node holds it, else hands it to the first replica
+void Node::write(QString key, QString value, bool deleted)
+{
+  if (!owns(key)) {
+    // only a replica knows the version to give it
+    Peer primary = ring->replicas(key).first();
+    Message msg(kMsgRumor);
+    msg.key = key;
+    msg.value = value;
+    msg.deleted = deleted;
+    msg.version = 0;
+    transport->send(msg, primary);
+    // resent until the primary acks it
+    hotRumors->add(msg);
+    return;
+  }
+  putLocal(key, value, deleted);
+}
+
+// writes the next version of key, or a tombstone, here and starts spreading it
+void Node::putLocal(QString key, QString value, bool deleted)
+{
+  // creates message for processing
+  Message msg(kMsgRumor);
+  msg.key = key;
+  msg.value = value;
+  msg.deleted = deleted;
+  msg.version = nextVersion(key);
+  msg.trace = tracer->start();
+
+  processRumor(msg, kTracePut);
+}
+
+// the version the next write of key here gets
+int Node::nextVersion(const QString &key)
+{
+  return qMax(vt->findVersion(key), versionFloor) + 1;
+}
+
+// processes a quorum response msg
+void Node::processQuorumResponse(const Message &msg)
+{
+  quorums->processQuorumResponse(msg);
+}
+
+// sending response to quorum call
+void Node::sendQuorumResponse(const Message &msg)
+{
+  QString key = msg.key;
+  int version = vt->findVersion(key);
+
+  // only send the value back if the version is as fresh or fresher
+  // than the one the requester has, an older one still votes so the
+  // requester can repair it
+  Message ackmsg(kMsgQuorumAck);
+  ackmsg.id = msg.id;
+  ackmsg.key = key;
+  ackmsg.version = version;
+  ackmsg.deleted = death->isDead(key);
+  if (msg.version <= version and !ackmsg.deleted) {
+    ackmsg.value = store->get(key);
+  }
+
+  transport->send(ackmsg, qMakePair(msg.host, msg.port));
+}
+
+// what this node holds of key, as its vote in a read
+Vote Node::localVote(const QString &key)
+{
+  Vote vote;
+  vote.version = vt->findVersion(key);
+  vote.deleted = death->isDead(key);
+  if (!vote.deleted) {
+    vote.value = store->get(key);
+  }
+  vote.from = self;
+  return vote;
+}
+
+// Pushes the version a read went with to the replicas that voted with an
+// older one, this node included. If every replica voted, this node holds
+// the newest version of the key as of when the read began and may answer
+// reads of it locally for staleReads ms from then.
+void Node::reviewVotes(const Quorum *quorum)
+{
+  const Vote *best = quorum->winner();
+  if (!best) {
+    return;
+  }
+
+  UpdateMap repair;
+  Update u;
+  u.version = best->version;
+  u.value = best->value;
+  u.deleted = best->deleted;
+  repair.insert(quorum->key, u);
+
+  for (int i = 0; i < quorum->responses.size(); ++i) {
+    const Vote &vote = quorum->responses.at(i);
+    if (vote.version >= best->version) {
+      continue;
+    }
+    Metrics::global()->readRepairs.add();
+    if (vote.from == self) {
+      placeUpdates(repair, best->from);
+    } else {
+      Message msg(kMsgUpdates);
+      msg.updates = repair;
+      transport->send(msg, vote.from);
+    }
+  }
+
+  if (owns(quorum->key) and quorum->responses.size() >= quorum->replicas and
+      vt->findVersion(quorum->key) >= best->version) {
+    leases->grant(quorum->key, quorum->since);
+  }
+}
+
+// whether this node is one of the replicas of key
+bool Node::owns(const QString &key) const
+{
+  return ring->isReplica(self, key);
+}
+
+// the versions of the keys that both this node and peer hold
+VersionMap Node::shared(const VersionMap &versions, const Peer &peer) const
+{
+  VersionMap out;
+  for (VersionMap::const_iterator i = versions.begin(); i != versions.end(); ++i) {
+    QList<Peer> replicas = ring->replicas(i.key());
+    if (replicas.contains(self) and replicas.contains(peer)) {
+      out.insert(i.key(), i.value());
+    }
+  }
+  return out;
+}
+
+// places the members believed alive and this node on the ring, and every
+// member heard of on the full ring
+void Node::rebuildRing()
+{
+  QList<Peer> members = membership->neighbors.toList();
+  members.append(self);
+  ring->rebuild(members);
+  QList<Peer> all = membership->all();
+  all.append(self);
+  fullRing->rebuild(all);
+  // replica sets may have changed under the leases
+  leases->clear();
+}
+
+// sends a hot rumor on to as many random other replicas of its key as the
+// gossip controller asks for
+void Node::spreadRumor(Message msg)
+{
+  if (msg.version == 0) {
+    // a forwarded put goes to the key's primary alone, this node if the
+    // ring moved the key here since
+    transport->send(msg, ring->replicas(msg.key).first());
+    return;
+  }
+
+  QList<Peer> replicas = ring->replicas(msg.key);
+  replicas.removeAll(self);
+  if (msg.trace.id) {
+    ++msg.trace.hops;
+  }
+  for (int i = 0; i < gossip->fanout() and !replicas.isEmpty(); ++i) {
+    Peer peer = replicas.takeAt(rand() % replicas.size());
+    transport->send(msg, peer);
+  }
+}
+
+// rumor mongering gave up on a traced update
+void Node::rumorStopped(Message msg)
+{
+  tracer->record(kTraceStopped, msg.key, msg.version, msg.trace);
+}
+
+// hands the settings the gossip controller picked from the last interval to the rumor table
+void Node::tuneGossip()
+{
+  gossip->update(transport->congested());
+  hotRumors->tune(gossip->rumorInterval(), gossip->stopOdds());
+}
+
+// acknowledges the rumor msg, a fresh one only once it is durable if the
+// store defers acks
+void Node::acknowledge(int ack, const Message &msg)
+{
+  if (ack == kAckFresh and store->defersAcks()) {
+    // the sender only hears that we took it once it survives a crash
+    Message acked = msg;
+    acked.value.clear();
+    pendingAcks.append(qMakePair(store->lastTicket(), acked));
+  } else {
+    sendAck(ack, msg);
+  }
+}
+
+// acknowledges the rumor msg to its sender
+void Node::sendAck(int ack, const Message &msg)
+{
+  Message ackmsg(kMsgAck);
+  ackmsg.ack = ack;
+  ackmsg.key = msg.key;
+  ackmsg.version = msg.version;
+  ackmsg.trace.id = msg.trace.id;
+
+  transport->send(ackmsg, qMakePair(msg.host, msg.port));
+}
+
+// sends the acks of the rumors written up to ticket
+void Node::releaseAcks(quint64 ticket)
+{
+  while (!pendingAcks.isEmpty() and pendingAcks.first().first <= ticket) {
+    sendAck(kAckFresh, pendingAcks.first().second);
+    pendingAcks.removeFirst();
+  }
+}
+
+// quorum over, decision made
+void Node::quorumDecision(quint32 id, QString key, QString value)
+{
+  emit getFinished(id, key, value);
+}
+
+// sends a request to all nodes for a key/value
+void Node::gatherQuorum(QString key, quint32 id)
+{
+  Message msg(kMsgQuorumCall);
+  msg.id = id;
+  msg.key = key;
+  // replicas behind it answer without value, a node that does not hold
+  // the key asks for everything
+  msg.version = owns(key) ? vt->findVersion(key) : 0;
+
+  QList<Peer> replicas = ring->replicas(key);
+  for (int i = 0; i < replicas.size(); ++i) {
+    if (replicas.at(i) != self) {
+      transport->send(msg, replicas.at(i));
+    }
+  }
+}
+
+// processes a get request, returns its request id, 0 if invalid
+// the answer arrives through getFinished with the same id
+quint32 Node::getRequest(QString key)
+{
+  // invalid get request with empty key
+  if (key.isEmpty()) {
+    return 0;
+  }
+
+  if (owns(key) and leases->holds(key)) {
+    // fresh enough, answered once the caller has the id
+    quint32 id = quorums->takeId();
+    QString value = store->get(key);
+    Metrics::global()->leaseReads.add();
+    QMetaObject::invokeMethod(this, "quorumDecision", Qt::QueuedConnection, Q_ARG(quint32, id),
+                              Q_ARG(QString, key), Q_ARG(QString, value));
+    return id;
+  }
+
+  // a node that does not hold the key only collects the replicas' votes
+  bool vote = owns(key);
+  Vote local;
+  if (vote) {
+    local = localVote(key);
+  }
+  quint32 id = quorums->start(key, ring->replicas(key), vote ? &local : 0);
+  gatherQuorum(key, id);
+  return id;
+}
+
+// processes a put of several keys at once, values[i] being the value of keys[i]
+void Node::multiPutRequest(QStringList keys, QStringList values)
+{
+  UpdateMap batch;
+  for (int i = 0; i < keys.size(); ++i) {
+    if (keys.at(i).isEmpty()) {
+      continue;
+    }
+    Update u;
+    u.value = values.value(i);
+    batch.insert(keys.at(i), u);
+  }
+
+  writeBatch(batch, false);
+}
+
+// Processes a get of several keys, returns its request id. Every replica
+// is asked once for all the keys it holds, each key is then decided by
+// its own quorum and the answers arrive together through multiGetFinished.
+quint32 Node::multiGetRequest(QStringList keys)
+{
+  bool leased = !keys.isEmpty();
+  for (int i = 0; i < keys.size() and leased; ++i) {
+    leased = owns(keys.at(i)) and leases->holds(keys.at(i));
+  }
+  if (leased) {
+    QStringList values;
+    for (int i = 0; i < keys.size(); ++i) {
+      values.append(store->get(keys.at(i)));
+    }
+    quint32 id = quorums->takeId();
+    Metrics::global()->leaseReads.add(keys.size());
+    QMetaObject::invokeMethod(this, "multiGetFinished", Qt::QueuedConnection, Q_ARG(quint32, id),
+                              Q_ARG(QStringList, keys), Q_ARG(QStringList, values));
+    return id;
+  }
+
+  QList<Quorum *> reads;
+  QHash<Peer, Message> calls;
+  for (int i = 0; i < keys.size(); ++i) {
+    const QString &key = keys.at(i);
+    QList<Peer> replicas = ring->replicas(key);
+    int version = owns(key) ? vt->findVersion(key) : 0;
+    Quorum *read = new Quorum(0, key, replicas);
+    if (owns(key)) {
+      read->addResponse(localVote(key));
+    }
+    reads.append(read);
+
+    for (int j = 0; j < replicas.size(); ++j) {
+      if (replicas.at(j) != self) {
+        calls[replicas.at(j)].state.insert(key, version);
+      }
+    }
+  }
+
+  quint32 id = quorums->startBatch(reads);
+  for (QHash<Peer, Message>::iterator p = calls.begin(); p != calls.end(); ++p) {
+    p.value().type = kMsgQuorumBatchCall;
+    p.value().id = id;
+    transport->send(p.value(), p.key());
+  }
+  return id;
+}
+
+// answers a batch quorum call with the versions of the keys held here, with
+// the values of those at least as fresh as the requester's
+void Node::sendBatchQuorumResponse(const Message &msg)
+{
+  Message reply(kMsgQuorumBatchAck);
+  reply.id = msg.id;
+  for (VersionMap::const_iterator i = msg.state.begin(); i != msg.state.end(); ++i) {
+    Update u;
+    u.version = vt->findVersion(i.key());
+    u.deleted = death->isDead(i.key());
+    if (i.value() <= u.version and !u.deleted) {
+      u.value = store->get(i.key());
+    }
+    reply.updates.insert(i.key(), u);
+  }
+  if (!reply.updates.isEmpty()) {
+    transport->send(reply, qMakePair(msg.host, msg.port));
+  }
+}
+
+// the value this node holds for key, without asking the other replicas
+QString Node::peekRequest(QString key)
+{
+  return store->get(key);
+}
+
+// counters of this node and the metrics of the process, one "name value" pair per line
+QString Node::statistics()
+{
+  QString out;
+  out += QString("keys %1\n").arg(vt->versions->size());
+  out += QString("hot_rumors %1\n").arg(hotRumors->size());
+  out += QString("quorums %1\n").arg(quorums->size());
+  out += QString("tombstones %1\n").arg(death->size());
+  out += QString("leases %1\n").arg(leases->size());
+  out += QString("members %1\n").arg(membership->neighbors.size() + 1);
+  out += Metrics::global()->text();
+  return out;
+}
+
+// replaces metricsFile with the current statistics, for a scraper to pick up
+void Node::dumpMetrics()
+{
+  QSaveFile file(metricsFile);
+  QByteArray text = statistics().toUtf8();
+  if (!file.open(QIODevice::WriteOnly) or file.write(text) != text.size() or !file.commit()) {
+    qWarning() << "failed to write metrics to " << metricsFile;
+  }
+}
+
+// processes a delete request, returns whether the delete was carried out
+bool Node::deleteRequest(QString key)
+{
+  // invalid delete request with empty key
+  if (key.isEmpty()) {
+    return false;
+  }
+
+  // the tombstone replicates like a put, reads of the key come back empty
+  write(key, QString(), true);
+  return true;
+}
+
+// Collects the tombstones that every replica of their key has seen. An
+// other replica that acked a delta past the change that recorded the
+// tombstone holds it or something newer, so once this node forgets the key
+// nothing can bring the deleted value back. The replicas are those of the
+// ring over the live members and those of the ring over every member, a
+// replica that is down now gets the key back once it returns and must have
+// the tombstone by then.
+//
+// A replica may still hold the tombstone when the key is written here
+// again, versions given out from then on stay above the tombstone's, or
+// the new value would lose to it.
+void Node::collectGarbage()
+{
+  QStringList expired = death->expired();
+  QStringList purged;
+  for (int i = 0; i < expired.size(); ++i) {
+    const QString &key = expired.at(i);
+    Tombstone tombstone = death->tombstone(key);
+    bool seen = true;
+    if (!death->overdue(tombstone)) {
+      QList<Peer> replicas = ring->replicas(key) + fullRing->replicas(key);
+      for (int j = 0; j < replicas.size() and seen; ++j) {
+        seen = replicas.at(j) == self or marks.value(replicas.at(j)).acked >= tombstone.seq;
+      }
+    }
+    if (seen) {
+      purged.append(key);
+      versionFloor = qMax(versionFloor, tombstone.version);
+    }
+  }
+
+  for (int i = 0; i < purged.size(); ++i) {
+    vt->removeVersion(purged.at(i));
+    death->revive(purged.at(i));
+    hotRumors->remove(purged.at(i));
+  }
+  if (!purged.isEmpty()) {
+    qDebug() << "collected " << purged.size() << " tombstones";
+    store->purge(purged);
+  }
+}
+
+Node::Node(Clock *clock)
+{
+  this->clock = clock;
+  transport = 0;
+  store = 0;
+  inbox = 0;
+  receiver = 0;
+  vt = new VersionTracker();
+  quorums = new QuorumManager(clock);
+  quorums->setParent(this);
+  connect(quorums, SIGNAL(quorumDecision(quint32, QString, QString)),
+          this, SLOT(quorumDecision(quint32, QString, QString)));
+  connect(quorums, SIGNAL(batchDecision(quint32, QStringList, QStringList)),
+          this, SIGNAL(multiGetFinished(quint32, QStringList, QStringList)));
+  connect(quorums, SIGNAL(voted(const Quorum *)), this, SLOT(reviewVotes(const Quorum *)));
+  membership = 0;
+  port = 0;
+  replicationFactor = 3;
+  ring = 0;
+  durability = kSyncInterval;
+  syncInterval = 50;
+  kAntiEntropyTimeout = 15000; // until the first round, the gossip controller paces the rest
+  kTuneInterval = 1000;
+  kMetricsInterval = 10000;
+  traceSample = 0;
+  tracer = 0;
+  staleReads = 0;
+  leases = 0;
+  kTreeStep = 4;        // levels of the tree descended per exchange
+  kMaxTreeNodes = 256;  // tree hashes per message
+  kTreeEvery = 4;       // anti-entropy rounds per hash tree comparison
+  kMaxDelta = 1024;     // keys per delta message
+  antiRound = 0;
+  versionFloor = 0;
+  fullRing = 0;
+  gossip = new GossipController();
+  death = 0;
+}
+
+Node::~Node()
+{
+  // the receiver pushes into the inbox until it is gone
+  delete(receiver);
+  delete(inbox);
+  // writes what is still pending, an AsyncStore lives on its own thread so it has no parent
+  delete(store);
+  delete(ring);
+  delete(fullRing);
+  delete(gossip);
+}
+
+// binds the socket, opens the store and starts gossiping, returns false
+// if no port was available or the store could not be opened
+bool Node::start()
+{
+  // a node restarted within the second must not repeat the ids it drew
+  srand(time(0) ^ getpid());
+
+	// Create a UDP network socket, it goes away with the node
+	NetSocket *sock = new NetSocket();
+	sock->setParent(this);
+	if (!sock->bind(port))
+		return false;
+  if (!advertise.isNull()) {
+    sock->address = advertise;
+  }
+
+  // directory to store key/values is just dir plus the port number, stored in directory db
+  QString dir = "db/dir" + QString::number(sock->boundPort);
+  mkdir("db", S_IRWXU);
+  mkdir(dir.toStdString().c_str(), S_IRWXU); // creates the directory
+
+  // writes go to the log on a thread of their own
+  LogStore *log = new LogStore();
+  AsyncStore *async = new AsyncStore(log, log, durability, syncInterval);
+  store = async;
+  if (!store->open(dir)) {
+    // takes the log along
+    delete(store);
+    store = 0;
+    return false;
+  }
+  connect(async, SIGNAL(durable(quint64)), this, SLOT(releaseAcks(quint64)));
+
+  // without seeds the cluster is the nodes on the default ports of this host
+  if (!start(sock, store, seeds.isEmpty() ? sock->defaultPeers() : seeds))
+    return false;
+  connect(sock, SIGNAL(congestion(bool)), hotRumors, SLOT(setDeferred(bool)));
+
+  // starts listening for messages, they come back decoded through drainInbox
+  inbox = new Inbox(this);
+  receiver = new Receiver(sock->socketDescriptor(), inbox);
+  receiver->start();
+
+  return true;
+}
+
+// Starts gossiping through transport, with storage opened and the members
+// in known taken to be up. Messages for this node are handed to
+// processMessage() by whoever receives them.
+bool Node::start(Transport *transport, Storage *storage, const QList<Peer> &known)
+{
+  this->transport = transport;
+  store = storage;
+  self = transport->self();
+  leases = new LeaseTable(staleReads, clock);
+  leases->setParent(this);
+  if (!ring) {
+    ring = new HashRing(replicationFactor);
+  }
+  if (!fullRing) {
+    fullRing = new HashRing(replicationFactor);
+  }
+  membership = new Membership(transport, known, clock);
+  membership->setParent(this);
+  connect(membership, SIGNAL(changed()), this, SLOT(rebuildRing()));
+  rebuildRing();
+
+  tracer = new Tracer(self, traceSample, clock);
+  tracer->setParent(this);
+  if (!traceLog.isEmpty() and !tracer->open(traceLog))
+    return false;
+
+  // versions come back with the store, so stale rumors are refused right away
+  QHash<QString, int> stored = store->versions();
+  for (QHash<QString, int>::const_iterator i = stored.begin(); i != stored.end(); ++i) {
+    vt->setVersion(i.key(), i.value());
+  }
+  // stored tombstones wait anew, until the neighbors acked everything loaded
+  death = new Death(clock);
+  death->setParent(this);
+  connect(death, SIGNAL(sweep()), this, SLOT(collectGarbage()));
+  QStringList dead = store->tombstones();
+  for (int i = 0; i < dead.size(); ++i) {
+    death->bury(dead.at(i), vt->findVersion(dead.at(i)), vt->versions->lastSeq());
+  }
+
+  hotRumors = new RumorTable(clock);
+  hotRumors->setParent(this);
+  connect(hotRumors, SIGNAL(sendRandomMessage(Message)),
+          this, SLOT(spreadRumor(Message)));
+  connect(hotRumors, SIGNAL(stopped(Message)), this, SLOT(rumorStopped(Message)));
+  // settings held fixed apply from the first rumor on, not from the first tuning
+  hotRumors->tune(gossip->rumorInterval(), gossip->stopOdds());
+
+  // every round of anti-entropy schedules the next one, the first comes at
+  // a random point so that nodes started together do not run in lockstep
+  clock->after(kAntiEntropyTimeout / 2 + rand() % (kAntiEntropyTimeout / 2), this, SLOT(sendAntiEntropy()));
+  clock->every(kTuneInterval, this, SLOT(tuneGossip()));
+  if (!metricsFile.isEmpty()) {
+    clock->every(kMetricsInterval, this, SLOT(dumpMetrics()));
+  }
+
+  return true;
+}
@@ -0,0 +1,121 @@
+#ifndef NODE_CLASS_HH
+#define NODE_CLASS_HH
+
+#include <QObject>
+#include <QHash>
+
+#include "clock.hh"
+#include "transport.hh"
+#include "hotrumor.hh"
+#include "quorum.hh"
+#include "gossip.hh"
+#include "death.hh"
+#include "membership.hh"
+#include "ring.hh"
+#include "versiontracker.hh"
+#include "asyncstore.hh"
+#include "receiver.hh"
+#include "tracer.hh"
+#include "lease.hh"
+
+// The storage/gossip engine of one database node, independent of any front
+// end. Its protocol runs on a Clock and sends through a Transport, start()
+// puts it on the wall clock, a udp socket and the log on disk, and a
+// Simulator runs it on its virtual clock and network instead.
+class Node : public QObject
+{
+  Q_OBJECT
+
+  public:
+    Node(Clock *clock = Clock::wall());
+    ~Node();
+    bool start();
+    bool start(Transport *transport, Storage *storage, const QList<Peer> &known);
+    void processMessage(const Message &);
+    int processRumor(Message, TraceEvent path = kTraceRumor);
+    bool applyUpdate(const QString &key, const Update &u);
+    void processRumorBatch(const Message &msg);
+    void writeBatch(const UpdateMap &batch, bool forwarded);
+    void attachAckMessage(const Message &);
+    void processEntropy(const Message &);
+    void processTree(const Message &);
+    void sendDelta(const Peer &peer);
+    bool owns(const QString &key) const;
+    VersionMap shared(const VersionMap &versions, const Peer &peer) const;
+    void write(QString key, QString value, bool deleted);
+    void putLocal(QString key, QString value, bool deleted = false);
+    int nextVersion(const QString &key);
+    void placeUpdates(const UpdateMap &, const Peer &from);
+    void gatherQuorum(QString, quint32 id);
+    void processQuorumResponse(const Message &msg);
+    void sendQuorumResponse(const Message &);
+    void sendBatchQuorumResponse(const Message &msg);
+    Vote localVote(const QString &key);
+    UpdateMap attachValuesToUpdates(const VersionMap &);
+    VersionMap findRequiredUpdates(const VersionMap &, const VersionMap &);
+
+    Clock *clock;
+    Transport *transport;
+    Inbox *inbox;
+    Receiver *receiver;
+    Storage *store;
+    Durability durability; // set before start()
+    int syncInterval;
+    int port;              // 0 for the first free default port
+    QList<Peer> seeds;     // the default ports of this host if empty
+    QHostAddress advertise; // the address other nodes reach this one at
+    int replicationFactor;
+    QString metricsFile;    // statistics() is written here every kMetricsInterval ms if set
+    QString traceLog;       // where traced updates are logged, none if empty
+    int traceSample;        // one put in traceSample starts a trace, 0 for none
+    int staleReads;         // ms a read may be answered from a lease, 0 for quorum reads only
+    Membership *membership;
+    HashRing *ring;         // which members hold which keys, made by start() unless set before
+    HashRing *fullRing;     // the same over every member heard of, down ones included
+    Peer self;
+    VersionTracker *vt;
+    RumorTable *hotRumors;
+    GossipController *gossip; // fanout, pace and stop odds of rumors, pace of anti-entropy
+    Death *death;           // tombstones of deleted keys until they are collected
+    QuorumManager *quorums; // outstanding reads by request id
+    Tracer *tracer;         // sampled updates on their way through the cluster
+    LeaseTable *leases;     // keys reads may be answered of locally
+
+  public slots:
+    void putRequest(QString key, QString value);
+    quint32 getRequest(QString key);
+    void multiPutRequest(QStringList keys, QStringList values);
+    quint32 multiGetRequest(QStringList keys);
+    QString peekRequest(QString key);
+    QString statistics();
+    bool deleteRequest(QString key);
+    void drainInbox();
+    void eliminateRumorByKey(QString key);
+    void sendAntiEntropy();
+    void quorumDecision(quint32 id, QString key, QString value);
+    void releaseAcks(quint64 ticket);
+    void rebuildRing();
+    void spreadRumor(Message msg);
+    void tuneGossip();
+    void collectGarbage();
+    void dumpMetrics();
+    void rumorStopped(Message msg);
+    void reviewVotes(const Quorum *quorum);
+
+  signals:
+    void antiEntropy();
+    void getFinished(quint32 id, QString key, QString value);
+    void multiGetFinished(quint32 id, QStringList keys, QStringList values);
+
+  private:
+    void acknowledge(int ack, const Message &msg);
+    void sendAck(int ack, const Message &msg);
+
+    QList<QPair<quint64, Message> > pendingAcks; // rumors waiting for their write to be durable, by ticket
+    QHash<Peer, SyncMark> marks; // anti-entropy watermarks of the neighbors
+    int antiRound;
+    int versionFloor; // above the version of every tombstone collected here
+    int kAntiEntropyTimeout, kTuneInterval, kMetricsInterval, kTreeStep, kMaxTreeNodes, kTreeEvery, kMaxDelta;
+};
+
+#endif
@@ -1,78 +1,259 @@
 #include <unistd.h>
 
 #include "quorum.hh"
+#include "metrics.hh"
 
-Quorum::Quorum(QString key, QString value, int version)
+Quorum::Quorum(quint32 id, QString key, const QList<Peer> &replicas)
+{
+  this->id = id;
+  this->key = key;
+  this->replicas = replicas.size();
+  pending = replicas;
+  started = Metrics::micros();
+  since = 0;
+}
+
+// counts the vote of a replica, returns false and ignores it if its sender
+// is no replica of the key or voted already, a resent answer counts once
+bool Quorum::addResponse(const Vote &vote)
+{
+  if (!pending.removeOne(vote.from)) {
+    return false;
+  }
+  responses.append(vote);
+  return true;
+}
+
+// whether more responses could no longer change the decision
+bool Quorum::settled() const
+{
+  if (responses.size() >= replicas) {
+    return true;
+  }
+
+  const Vote *best = winner();
+  int agree = 0;
+  for (int i = 0; best and i < responses.size(); ++i) {
+    if (responses.at(i).version == best->version and responses.at(i).value == best->value) {
+      ++agree;
+    }
+  }
+  return agree > replicas / 2;
+}
+
+// the vote the read goes with: the most common value of the newest
+// version, the first one seen on a tie, 0 if there is no vote yet
+const Vote *Quorum::winner() const
+{
+  int maxVersion = 0;
+  for (int i = 0; i < responses.size(); ++i) {
+    maxVersion = qMax(maxVersion, responses.at(i).version);
+  }
+
+  QHash<QString, int> valueCounts;
+  const Vote *best = 0;
+  int largestCount = 0;
+  for (int i = 0; i < responses.size(); ++i) {
+    if (responses.at(i).version != maxVersion) {
+      continue;
+    }
+    int count = ++valueCounts[responses.at(i).value];
+    if (count > largestCount) {
+      largestCount = count;
+      best = &responses.at(i);
+    }
+  }
+  return best;
+}
+
+// decides from the list of responses the proper quorum result
+QString Quorum::decide() const
+{
+  const Vote *best = winner();
+  return best ? best->value : QString();
+}
+
+QuorumManager::QuorumManager(Clock *clock)
 {
   kTimeout = 1000;
-  timer = new QTimer(this);
-  connect(timer, SIGNAL(timeout()), this, SLOT(decideQuorum()));
-  timer->start(kTimeout);
-  key = key;
-  responses = new QVector<QPair<QString, int> >();
-  responses->append(qMakePair(value, version));
+  nextId = 1;
+  this->clock = clock;
+
+  // 50 ms ticks, a 1000 ms timeout is 20 slots away
+  wheel = new TimerWheel(32, 50);
+  clock->every(wheel->tick(), this, SLOT(tick()));
+}
+
+QuorumManager::~QuorumManager()
+{
+  qDeleteAll(quorums);
+  for (QHash<quint32, QuorumBatch *>::const_iterator i = batches.begin(); i != batches.end(); ++i) {
+    qDeleteAll(i.value()->reads);
+  }
+  qDeleteAll(batches);
+  delete(wheel);
+}
+
+// next request id, single and batch reads share them
+quint32 QuorumManager::takeId()
+{
+  quint32 id = nextId++;
+  if (nextId == 0) {
+    nextId = 1;
+  }
+  return id;
+}
+
+// starts a read of key from replicas, with the local vote as first vote
+// if this node is one of them, returns its id
+quint32 QuorumManager::start(QString key, const QList<Peer> &replicas, const Vote *local)
+{
+  quint32 id = takeId();
+
+  Quorum *quorum = new Quorum(id, key, replicas);
+  quorum->since = clock->now();
+  if (local) {
+    quorum->addResponse(*local);
+  }
+  quorums.insert(id, quorum);
+
+  // a lone node decides on the next tick, after the caller has the id
+  wheel->schedule(QString(), id, local and quorum->settled() ? 0 : kTimeout);
+  return id;
 }
 
 // processes a quorum response msg
-void Quorum::processQuorumResponse(QVariantMap msg)
+void QuorumManager::processQuorumResponse(const Message &msg)
 {
-  QPair<QString, int> response = qMakePair(msg[QString("Value")].toString(), msg[QString("Version")].toInt());
-  responses->append(response);
+  Quorum *quorum = quorums.value(msg.id);
+  if (!quorum or quorum->key != msg.key) {
+    // decided already, or not ours
+    return;
+  }
+
+  Vote vote;
+  vote.value = msg.value;
+  vote.version = msg.version;
+  vote.deleted = msg.deleted;
+  vote.from = qMakePair(msg.host, msg.port);
+  if (quorum->addResponse(vote) and quorum->settled()) {
+    finish(msg.id);
+  }
 }
 
-// decides from the list of responses the proper quorum result
-void Quorum::decideQuorum()
-{
-  if (responses->size() > 0) {
-    int maxVersion = responses->at(0).second;
-    QVector<QPair<QString, int> > valueCounts;
-    for (int i = 0; i < responses->size(); ++i) {
-      QPair<QString, int> response = responses->at(i);
-      // new max version, so new valueCounts as well
-      if (response.second > maxVersion) {
-        maxVersion = response.second;
-        QVector<QPair<QString, int> > temp;
-        valueCounts = temp;
-        valueCounts.append(response);
-      } else if (response.second == maxVersion) {
-        bool foundValue = false;
-        for (int j = 0; j < valueCounts.size(); ++j) {
-          QPair<QString, int> vc = valueCounts.at(i);
-          if (vc.first == response.first) {
-            vc.second = vc.second + 1;
-            foundValue = true;
-            break;
-          }
-        }
-
-        // add new valueCount to the mix
-        if (not foundValue) {
-          valueCounts.append(qMakePair(response.first, 1));
-        }
-      }
+// starts a read of several keys, one quorum each with the local vote
+// already cast where there is one, takes the quorums over and returns the
+// id shared by all of them
+quint32 QuorumManager::startBatch(const QList<Quorum *> &reads)
+{
+  quint32 id = takeId();
+  QuorumBatch *batch = new QuorumBatch;
+  batch->reads = reads;
+  batch->unsettled = 0;
+  for (int i = 0; i < reads.size(); ++i) {
+    reads.at(i)->id = id;
+    reads.at(i)->since = clock->now();
+    batch->byKey.insert(reads.at(i)->key, reads.at(i));
+    if (!reads.at(i)->settled()) {
+      ++batch->unsettled;
     }
+  }
+  batches.insert(id, batch);
+
+  wheel->schedule(QString(), id, batch->unsettled == 0 ? 0 : kTimeout);
+  return id;
+}
 
-    // find largest count
-    int largestCount = valueCounts.at(0).second;
-    for (int i = 0; i < valueCounts.size(); ++i) {
-      if (valueCounts.at(i).second > largestCount) {
-        largestCount = valueCounts.at(i).second;
+// counts the votes of a replica for the keys of a batch read
+void QuorumManager::processBatchResponse(const Message &msg)
+{
+  QuorumBatch *batch = batches.value(msg.id);
+  if (!batch) {
+    return;
+  }
+
+  for (UpdateMap::const_iterator i = msg.updates.begin(); i != msg.updates.end(); ++i) {
+    QList<Quorum *> reads = batch->byKey.values(i.key());
+    for (int j = 0; j < reads.size(); ++j) {
+      // a settled key is decided, like a single read that finished
+      if (reads.at(j)->settled()) {
+        continue;
+      }
+      Vote vote;
+      vote.value = i.value().value;
+      vote.version = i.value().version;
+      vote.deleted = i.value().deleted;
+      vote.from = qMakePair(msg.host, msg.port);
+      if (reads.at(j)->addResponse(vote) and reads.at(j)->settled()) {
+        --batch->unsettled;
       }
     }
+  }
+  if (batch->unsettled == 0) {
+    finishBatch(msg.id);
+  }
+}
 
-    // return first instance of that largest count
-    for (int i = 0; i < valueCounts.size(); ++i) {
-      if (valueCounts.at(i).second == largestCount) {
-        emit(quorumDecision(valueCounts.at(i).first));
-        return;
-      }
+int QuorumManager::size() const
+{
+  return quorums.size() + batches.size();
+}
+
+// decides the reads whose timeout expired on this tick
+void QuorumManager::tick()
+{
+  QList<QPair<QString, quint64> > due = wheel->advance();
+  for (int i = 0; i < due.size(); ++i) {
+    if (quorums.contains(due.at(i).second)) {
+      finish(due.at(i).second);
+    } else if (batches.contains(due.at(i).second)) {
+      finishBatch(due.at(i).second);
     }
   }
 }
 
-Quorum::~Quorum()
+// quorum over, decision made
+void QuorumManager::finish(quint32 id)
+{
+  Quorum *quorum = quorums.take(id);
+  account(quorum);
+  emit voted(quorum);
+  emit quorumDecision(id, quorum->key, quorum->decide());
+  delete(quorum);
+}
+
+// batch over, every key decided on its own
+void QuorumManager::finishBatch(quint32 id)
+{
+  QuorumBatch *batch = batches.take(id);
+  QStringList keys, values;
+  for (int i = 0; i < batch->reads.size(); ++i) {
+    account(batch->reads.at(i));
+    emit voted(batch->reads.at(i));
+    keys.append(batch->reads.at(i)->key);
+    values.append(batch->reads.at(i)->decide());
+  }
+  emit batchDecision(id, keys, values);
+  qDeleteAll(batch->reads);
+  delete(batch);
+}
+
+// counts a read that is being decided in the metrics
+void QuorumManager::account(const Quorum *quorum)
 {
-  if (timer) {
-    delete(timer);
+  Metrics *metrics = Metrics::global();
+  metrics->quorumsDecided.add();
+  metrics->quorumLatency.record(Metrics::micros() - quorum->started);
+  if (!quorum->settled()) {
+    metrics->quorumsTimedOut.add();
+  }
+
+  bool unanimous = quorum->responses.size() >= quorum->replicas;
+  for (int i = 1; unanimous and i < quorum->responses.size(); ++i) {
+    unanimous = quorum->responses.at(i).version == quorum->responses.at(0).version and
+                quorum->responses.at(i).value == quorum->responses.at(0).value;
+  }
+  if (unanimous) {
+    metrics->quorumsUnanimous.add();
   }
 }
@@ -1,30 +1,95 @@
 #ifndef QUORUM_CLASS_HH
 #define QUORUM_CLASS_HH
 
-#include <QVariantMap>
-#include <QTimer>
+#include <QHash>
+#include <QMultiHash>
+#include <QStringList>
+#include <QObject>
 #include <QVector>
 
-class Quorum : public QObject
+#include "clock.hh"
+#include "message.hh"
+#include "timerwheel.hh"
+
+typedef QPair<QHostAddress, int> Peer;
+
+// what one replica answered to a read, a replica behind the requester
+// votes with its version only
+struct Vote
 {
-  Q_OBJECT
+  Vote() : version(0), deleted(false) {}
+
+  QString value;
+  int version;
+  bool deleted;
+  Peer from;
+};
 
+// one outstanding read, collecting one vote from each of the replicas
+class Quorum
+{
   public:
-    Quorum(QString, QString, int);
-    ~Quorum();
-    void processQuorumResponse(QVariantMap);
+    Quorum(quint32 id, QString key, const QList<Peer> &replicas);
+    bool addResponse(const Vote &vote);
+    bool settled() const;
+    QString decide() const;
+    const Vote *winner() const;
 
-    QTimer *timer;
+    quint32 id;
     QString key;
-    QVector<QPair<QString, int> > *responses;
+    int replicas; // votes expected, this node included
+    QList<Peer> pending; // replicas that have not voted yet
+    QVector<Vote> responses;
+    qint64 started; // Metrics::micros() when the read began
+    qint64 since;   // ms on the manager's clock when the read began
+};
+
+// one outstanding read of several keys, decided key by key and answered at once
+struct QuorumBatch
+{
+  QList<Quorum *> reads;               // in the order the keys were asked for
+  QMultiHash<QString, Quorum *> byKey;
+  int unsettled;                       // reads more votes could still change
+};
+
+// Tracks every outstanding read by request id. A read is decided as soon as
+// all replicas answered or a majority agrees on the newest version seen,
+// and after kTimeout ms with whatever votes arrived otherwise. A batch read
+// waits until every one of its keys is decided that way. Ids of reads
+// answered without a quorum come from takeId() as well.
+class QuorumManager : public QObject
+{
+  Q_OBJECT
+
+  public:
+    QuorumManager(Clock *clock = Clock::wall());
+    ~QuorumManager();
+    quint32 start(QString key, const QList<Peer> &replicas, const Vote *local = 0);
+    void processQuorumResponse(const Message &msg);
+    quint32 startBatch(const QList<Quorum *> &reads);
+    void processBatchResponse(const Message &msg);
+    int size() const;
+    quint32 takeId();
 
   public slots:
-    void decideQuorum();
+    void tick();
 
   signals:
-    void quorumDecision(QString);
+    void quorumDecision(quint32 id, QString key, QString value);
+    void batchDecision(quint32 id, QStringList keys, QStringList values);
+    // every read right before its decision, quorum is gone after the call
+    void voted(const Quorum *quorum);
 
   private:
+    void account(const Quorum *quorum);
+    void finish(quint32 id);
+    void finishBatch(quint32 id);
+
+    QHash<quint32, Quorum *> quorums;
+    QHash<quint32, QuorumBatch *> batches;
+    TimerWheel *wheel;
+    Clock *clock;
+    quint32 nextId;
     int kTimeout;
 };
 
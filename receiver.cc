@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <QDebug>
+
+#include "receiver.hh"
+#include "metrics.hh"
+
+Inbox::Inbox(QObject *applier)
+{
+  this->applier = applier;
+}
+
+// called from the decode workers
+void Inbox::push(Message *msg)
+{
+  queue.push(msg);
+  if (armed.testAndSetOrdered(0, 1)) {
+    QMetaObject::invokeMethod(applier, "drainInbox", Qt::QueuedConnection);
+  }
+}
+
+// called from the applier only
+Message *Inbox::pop()
+{
+  return queue.pop();
+}
+
+// called by the applier before it drains, so pushes from then on wake it again
+void Inbox::rearm()
+{
+  armed.store(0);
+}
+
+Receiver::Receiver(int fd, Inbox *inbox)
+{
+  this->fd = fd;
+  this->inbox = inbox;
+  kBatch = 64;
+  kPollTimeout = 100; // ms between checks for stop()
+  kMaxDatagram = 65536;
+
+  decoders = new QThreadPool(this);
+  decoders->setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 2));
+
+  buffer.resize(kBatch * kMaxDatagram);
+  addrs.resize(kBatch);
+#ifdef __linux__
+  msgs.resize(kBatch);
+  iovs.resize(kBatch);
+  memset(msgs.data(), 0, sizeof(struct mmsghdr) * kBatch);
+  for (int i = 0; i < kBatch; ++i) {
+    iovs[i].iov_base = buffer.data() + i * kMaxDatagram;
+    iovs[i].iov_len = kMaxDatagram;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+  }
+#endif
+}
+
+Receiver::~Receiver()
+{
+  stop();
+  wait();
+  decoders->waitForDone();
+}
+
+void Receiver::stop()
+{
+  stopping.store(1);
+}
+
+void Receiver::run()
+{
+  QVector<Datagram> batch;
+  while (!stopping.load()) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, kPollTimeout) <= 0) {
+      continue;
+    }
+
+    // drain everything that is queued on the socket before handing off
+    while (readBatch(batch) > 0) {
+      decoders->start(new DecodeTask(batch, inbox));
+      batch.clear();
+    }
+  }
+}
+
+// sender address of a received datagram, the port sits at the same offset for ipv6
+static void setSender(Datagram &d, const struct sockaddr_storage &addr)
+{
+  d.host = QHostAddress((const struct sockaddr *)&addr);
+  d.port = ntohs(((const struct sockaddr_in *)&addr)->sin_port);
+
+  // the socket is dual stack, ipv4 peers show up as ::ffff:a.b.c.d
+  bool ipv4 = false;
+  quint32 v4 = d.host.toIPv4Address(&ipv4);
+  if (ipv4) {
+    d.host = QHostAddress(v4);
+  }
+}
+
+#ifdef __linux__
+// reads up to kBatch datagrams with one recvmmsg, returns how many
+int Receiver::readBatch(QVector<Datagram> &batch)
+{
+  for (int i = 0; i < kBatch; ++i) {
+    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+  }
+
+  int n;
+  do {
+    n = recvmmsg(fd, msgs.data(), kBatch, MSG_DONTWAIT, 0);
+  } while (n < 0 and errno == EINTR);
+  if (n < 0) {
+    if (errno != EAGAIN and errno != EWOULDBLOCK) {
+      qWarning() << "recvmmsg failed: " << strerror(errno);
+    }
+    return 0;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    Datagram d;
+    d.data = QByteArray(buffer.constData() + i * kMaxDatagram, msgs[i].msg_len);
+    setSender(d, addrs[i]);
+    batch.append(d);
+    Metrics::global()->bytesReceived.add(d.data.size());
+  }
+  Metrics::global()->datagramsReceived.add(n);
+  return n;
+}
+#else
+// one recvfrom per datagram where recvmmsg is not available
+int Receiver::readBatch(QVector<Datagram> &batch)
+{
+  for (int i = 0; i < kBatch; ++i) {
+    socklen_t addrlen = sizeof(struct sockaddr_storage);
+    ssize_t n = recvfrom(fd, buffer.data(), kMaxDatagram, MSG_DONTWAIT,
+                         (struct sockaddr *)&addrs[0], &addrlen);
+    if (n < 0) {
+      break;
+    }
+    Datagram d;
+    d.data = QByteArray(buffer.constData(), n);
+    setSender(d, addrs[0]);
+    batch.append(d);
+    Metrics::global()->datagramsReceived.add();
+    Metrics::global()->bytesReceived.add(n);
+  }
+  return batch.size();
+}
+#endif
+
+DecodeTask::DecodeTask(const QVector<Datagram> &batch, Inbox *inbox)
+{
+  this->batch = batch;
+  this->inbox = inbox;
+}
+
+void DecodeTask::run()
+{
+  for (int i = 0; i < batch.size(); ++i) {
+    Message *msg = new Message();
+    if (!msg->decode(batch.at(i).data.constData(), batch.at(i).data.size())) {
+      // malformed or from a newer wire version
+      Metrics::global()->decodeErrors.add();
+      delete msg;
+      continue;
+    }
+    msg->host = batch.at(i).host;
+    msg->port = batch.at(i).port;
+    inbox->push(msg);
+  }
+}
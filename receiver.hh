@@ -0,0 +1,84 @@
+#ifndef RECEIVER_CLASS_HH
+#define RECEIVER_CLASS_HH
+
+#include <QAtomicInt>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QVector>
+#include <sys/socket.h>
+
+#include "message.hh"
+#include "mpscqueue.hh"
+
+// a datagram as it came off the socket
+struct Datagram
+{
+  QByteArray data;
+  QHostAddress host;
+  quint16 port;
+};
+
+// Decoded messages waiting for the thread that owns the node state.
+// The first push after the applier emptied the inbox posts one call of
+// the applier's drainInbox() slot, later pushes ride along with it.
+class Inbox
+{
+  public:
+    Inbox(QObject *applier);
+    void push(Message *msg);
+    Message *pop();
+    void rearm();
+
+  private:
+    MpscQueue<Message> queue;
+    QAtomicInt armed;
+    QObject *applier;
+};
+
+// Reads datagrams off a bound udp socket on its own thread, up to kBatch per
+// system call, and hands every batch to a pool of decode workers that push
+// the decoded messages into the inbox.
+class Receiver : public QThread
+{
+  Q_OBJECT
+
+  public:
+    Receiver(int fd, Inbox *inbox);
+    ~Receiver();
+    void stop();
+
+  protected:
+    void run();
+
+  private:
+    int readBatch(QVector<Datagram> &batch);
+
+    int fd;
+    Inbox *inbox;
+    QThreadPool *decoders;
+    QAtomicInt stopping;
+    int kBatch, kPollTimeout, kMaxDatagram;
+
+    // receive buffers for one batch, reused by every read
+    QByteArray buffer;
+    QVector<struct sockaddr_storage> addrs;
+#ifdef __linux__
+    QVector<struct mmsghdr> msgs;
+    QVector<struct iovec> iovs;
+#endif
+};
+
+// decodes one batch of datagrams on a pool thread
+class DecodeTask : public QRunnable
+{
+  public:
+    DecodeTask(const QVector<Datagram> &batch, Inbox *inbox);
+    void run();
+
+  private:
+    QVector<Datagram> batch;
+    Inbox *inbox;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include <algorithm>
+
+#include <QSet>
+
+#include "ring.hh"
+
+// 64 bit fnv-1a, then the splitmix64 finalizer so that nearby inputs land
+// far apart on the ring
+static quint64 ringHash(const QByteArray &bytes)
+{
+  quint64 h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < bytes.size(); ++i) {
+    h ^= (uchar)bytes.at(i);
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+HashRing::HashRing(int replicationFactor)
+{
+  factor = replicationFactor;
+}
+
+int HashRing::replicationFactor() const
+{
+  return factor;
+}
+
+// places the virtual nodes of every member, nothing moves if only their
+// order changed, and a ring copied from one over the same members keeps
+// sharing its points with it
+void HashRing::rebuild(const QList<Peer> &members)
+{
+  if (members.size() == this->members.size() and
+      QSet<Peer>::fromList(members) == QSet<Peer>::fromList(this->members)) {
+    return;
+  }
+  this->members = members;
+  points.clear();
+  points.reserve(members.size() * kVirtualNodes);
+  for (int m = 0; m < members.size(); ++m) {
+    QByteArray id = (members.at(m).first.toString() + ":" + QString::number(members.at(m).second)).toUtf8();
+    for (int v = 0; v < kVirtualNodes; ++v) {
+      QByteArray point = id;
+      point.append('#');
+      point.append(QByteArray::number(v));
+      points.append(qMakePair(ringHash(point), m));
+    }
+  }
+  std::sort(points.begin(), points.end());
+}
+
+// the members holding key, in preference order
+QList<Peer> HashRing::replicas(const QString &key) const
+{
+  QList<Peer> out;
+  if (points.isEmpty()) {
+    return out;
+  }
+
+  // first point at or after the key, wrapping around
+  quint64 h = ringHash(key.toUtf8());
+  int lo = 0, hi = points.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (points.at(mid).first < h) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  int wanted = qMin(factor, members.size());
+  QVector<bool> taken(members.size(), false);
+  for (int i = 0; i < points.size() and out.size() < wanted; ++i) {
+    int m = points.at((lo + i) % points.size()).second;
+    if (!taken.at(m)) {
+      taken[m] = true;
+      out.append(members.at(m));
+    }
+  }
+  return out;
+}
+
+bool HashRing::isReplica(const Peer &peer, const QString &key) const
+{
+  return replicas(key).contains(peer);
+}
@@ -0,0 +1,35 @@
+#ifndef RING_CLASS_HH
+#define RING_CLASS_HH
+
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+typedef QPair<QHostAddress, int> Peer;
+
+// Consistent hash ring over the members of the cluster.
+// Every member owns kVirtualNodes points on a 64 bit ring, placed by a hash
+// of its address and port that is the same on every node, and the replicas
+// of a key are the first replicationFactor distinct members clockwise from
+// the hash of the key. Adding or removing a member only moves the keys
+// between it and its neighbors on the ring.
+class HashRing
+{
+  public:
+    HashRing(int replicationFactor);
+    void rebuild(const QList<Peer> &members);
+    QList<Peer> replicas(const QString &key) const;
+    bool isReplica(const Peer &peer, const QString &key) const;
+    int replicationFactor() const;
+
+    static const int kVirtualNodes = 64;
+
+  private:
+    QVector<QPair<quint64, int> > points; // sorted by position on the ring
+    QList<Peer> members;
+    int factor;
+};
+
+#endif
@@ -0,0 +1,24 @@
+# deterministic cluster simulator, build with: qmake && make
+# and run ./gossipsim (see --help for the cluster and network options)
+
+TEMPLATE = app
+TARGET = gossipsim
+CONFIG += console
+CONFIG -= app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+QT += network
+QT -= gui
+
+# Input
+HEADERS += simulator.hh simstore.hh ../node.hh ../transport.hh ../clock.hh ../storage.hh \
+           ../netsocket.hh ../streamer.hh ../membership.hh ../message.hh ../merkle.hh \
+           ../ring.hh ../versiontable.hh ../versiontracker.hh ../valuecache.hh \
+           ../logstore.hh ../asyncstore.hh ../mpscqueue.hh ../receiver.hh ../timerwheel.hh \
+           ../hotrumor.hh ../gossip.hh ../death.hh ../quorum.hh ../metrics.hh ../tracer.hh \
+           ../lease.hh
+SOURCES += main.cc simulator.cc simstore.cc ../node.cc ../clock.cc ../netsocket.cc \
+           ../streamer.cc ../membership.cc ../message.cc ../merkle.cc ../ring.cc \
+           ../versiontable.cc ../versiontracker.cc ../valuecache.cc ../logstore.cc \
+           ../asyncstore.cc ../receiver.cc ../timerwheel.cc ../hotrumor.cc ../gossip.cc \
+           ../death.cc ../quorum.cc ../metrics.cc ../tracer.cc ../lease.cc
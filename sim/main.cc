@@ -0,0 +1,212 @@
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QVector>
+
+#include "node.hh"
+#include "simstore.hh"
+#include "simulator.hh"
+
+// Runs a cluster of Nodes on a simulated clock and network and reports how
+// long updates take to reach all their replicas, and what it costs in
+// datagrams and bytes, membership pings included, as JSON. The same
+// options and seed give the same run, so settings can be compared at
+// cluster sizes and loss rates a local cluster does not reach.
+
+struct Options
+{
+  int nodes;
+  unsigned seed;
+  int updates;
+  double rate;        // updates per simulated second
+  int replicas;       // 0 for every node
+  NetworkModel net;
+  FixedGossip fixed;
+  qint64 duration;    // simulated ms the run may take at most
+  QString out;
+};
+
+static double percentile(QVector<double> samples, double p)
+{
+  if (samples.isEmpty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  int i = qMin(samples.size() - 1, (int)(p * samples.size()));
+  return samples.at(i);
+}
+
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog
+            << " [--nodes N] [--seed S] [--updates N] [--rate PER_SECOND] [--replicas N]"
+            << " [--loss P] [--latency MS] [--jitter MS] [--partition FROM_MS:TO_MS:GROUPS]"
+            << " [--stop-odds N] [--fanout N] [--rumor-interval MS] [--anti-entropy MS]"
+            << " [--duration MS] [--out FILE]" << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, Options &opt)
+{
+  opt.nodes = 50;
+  opt.seed = 1;
+  opt.updates = 1000;
+  opt.rate = 100;
+  opt.replicas = 3;
+  opt.net.loss = 0;
+  opt.net.latency = 1;
+  opt.net.jitter = 2;
+  opt.net.partitionFrom = 0;
+  opt.net.partitionTo = 0;
+  opt.net.partitionGroups = 1;
+  opt.fixed.stopOdds = 0;
+  opt.fixed.fanout = 0;
+  opt.fixed.rumorInterval = 0;
+  opt.fixed.antiEntropy = 0;
+  opt.duration = 600000;
+
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    QString name = argv[i];
+    QString value = argv[++i];
+    if (name == "--nodes") {
+      opt.nodes = qMax(1, value.toInt());
+    } else if (name == "--seed") {
+      opt.seed = value.toUInt();
+    } else if (name == "--updates") {
+      opt.updates = qMax(0, value.toInt());
+    } else if (name == "--rate") {
+      opt.rate = qMax(1e-3, value.toDouble());
+    } else if (name == "--replicas") {
+      opt.replicas = qMax(0, value.toInt());
+    } else if (name == "--loss") {
+      opt.net.loss = qBound(0.0, value.toDouble(), 1.0);
+    } else if (name == "--latency") {
+      opt.net.latency = qMax(0, value.toInt());
+    } else if (name == "--jitter") {
+      opt.net.jitter = qMax(0, value.toInt());
+    } else if (name == "--partition") {
+      QStringList parts = value.split(':');
+      if (parts.size() != 3) {
+        return false;
+      }
+      opt.net.partitionFrom = parts.at(0).toLongLong();
+      opt.net.partitionTo = parts.at(1).toLongLong();
+      opt.net.partitionGroups = qMax(1, parts.at(2).toInt());
+    } else if (name == "--stop-odds") {
+      opt.fixed.stopOdds = qMax(0, value.toInt());
+    } else if (name == "--fanout") {
+      opt.fixed.fanout = qMax(0, value.toInt());
+    } else if (name == "--rumor-interval") {
+      opt.fixed.rumorInterval = qMax(0, value.toInt());
+    } else if (name == "--anti-entropy") {
+      opt.fixed.antiEntropy = qMax(0, value.toInt());
+    } else if (name == "--duration") {
+      opt.duration = value.toLongLong();
+    } else if (name == "--out") {
+      opt.out = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static QString json(const QString &name, double value)
+{
+  return QString("\"%1\": %2").arg(name).arg(value, 0, 'f', 3);
+}
+
+int main(int argc, char **argv)
+{
+  QCoreApplication app(argc, argv);
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // hash order decides iteration order in the nodes, fix it along with rand()
+  qSetGlobalQHashSeed(0);
+  srand(opt.seed);
+
+  QElapsedTimer wall;
+  wall.start();
+
+  // every node starts out with all the others alive, on a copy of the same
+  // ring, which they share until their views of the members part
+  Simulator sim(opt.net);
+  QList<Peer> members;
+  for (int n = 0; n < opt.nodes; ++n) {
+    members.append(Simulator::peerOf(n));
+  }
+  HashRing ring(opt.replicas ? opt.replicas : opt.nodes);
+  ring.rebuild(members);
+  QList<Node *> nodes;
+  for (int n = 0; n < opt.nodes; ++n) {
+    Node *node = new Node(&sim);
+    node->replicationFactor = ring.replicationFactor();
+    node->ring = new HashRing(ring);
+    node->fullRing = new HashRing(ring);
+    node->gossip->fix(opt.fixed);
+    if (!node->start(sim.addNode(node), new SimStore(&sim), members)) {
+      std::cerr << "could not start node " << n << std::endl;
+      return 1;
+    }
+    nodes.append(node);
+  }
+
+  // puts go to a random replica of a fresh key, spread evenly over time
+  for (int i = 0; i < opt.updates; ++i) {
+    qint64 at = (qint64)(i * 1000 / opt.rate);
+    if (at > opt.duration) {
+      break;
+    }
+    sim.run(at);
+    QString key = QString("key%1").arg(i);
+    QList<Peer> replicas = ring.replicas(key);
+    sim.track(key, 1, replicas.size());
+    nodes.at(Simulator::indexOf(replicas.at(rand() % replicas.size())))->putRequest(key, "value");
+  }
+
+  const int kStep = 100;
+  while (sim.unconverged() > 0 and sim.now() < opt.duration) {
+    sim.run(qMin(sim.now() + kStep, opt.duration));
+  }
+  double seconds = wall.nsecsElapsed() / 1e9;
+  int updates = qMax(1, sim.convergence.size() + sim.unconverged());
+
+  QStringList fields;
+  fields << json("nodes", opt.nodes) << json("replicas", ring.replicationFactor())
+         << json("seed", opt.seed) << json("updates", sim.convergence.size() + sim.unconverged())
+         << json("loss", opt.net.loss)
+         << json("unconverged", sim.unconverged())
+         << json("convergence_ms_p50", percentile(sim.convergence, 0.5))
+         << json("convergence_ms_p99", percentile(sim.convergence, 0.99))
+         << json("convergence_ms_max", percentile(sim.convergence, 1.0))
+         << json("datagrams_per_update", (double)sim.datagrams / updates)
+         << json("bytes_per_update", (double)sim.bytes / updates)
+         << json("dropped", sim.dropped)
+         << json("simulated_seconds", sim.now() / 1e3)
+         << json("wall_seconds", seconds);
+  QByteArray report = ("{\n  " + fields.join(",\n  ") + "\n}\n").toUtf8();
+
+  if (opt.out.isEmpty()) {
+    std::cout << report.constData();
+  } else {
+    QFile file(opt.out);
+    if (!file.open(QIODevice::WriteOnly) or file.write(report) != report.size()) {
+      std::cerr << "could not write " << opt.out.toStdString() << std::endl;
+      return 1;
+    }
+  }
+
+  qDeleteAll(nodes);
+  return sim.unconverged() == 0 ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#include "simstore.hh"
+#include "simulator.hh"
+
+SimStore::SimStore(Simulator *sim)
+{
+  this->sim = sim;
+}
+
+// nothing to open, a simulated node starts empty
+bool SimStore::open(QString dir)
+{
+  Q_UNUSED(dir);
+  return true;
+}
+
+void SimStore::put(QString key, int version, QString value)
+{
+  Update &u = values[key];
+  u.version = version;
+  u.value = value;
+  u.deleted = false;
+  sim->applied(key, version);
+}
+
+void SimStore::remove(QString key, int version)
+{
+  Update &u = values[key];
+  u.version = version;
+  u.value.clear();
+  u.deleted = true;
+  sim->applied(key, version);
+}
+
+QString SimStore::get(QString key)
+{
+  return values.value(key).value;
+}
+
+QHash<QString, int> SimStore::versions()
+{
+  QHash<QString, int> out;
+  for (QHash<QString, Update>::const_iterator i = values.begin(); i != values.end(); ++i) {
+    out.insert(i.key(), i.value().version);
+  }
+  return out;
+}
+
+QStringList SimStore::tombstones()
+{
+  QStringList out;
+  for (QHash<QString, Update>::const_iterator i = values.begin(); i != values.end(); ++i) {
+    if (i.value().deleted) {
+      out.append(i.key());
+    }
+  }
+  return out;
+}
+
+void SimStore::purge(const QStringList &keys)
+{
+  for (int i = 0; i < keys.size(); ++i) {
+    QHash<QString, Update>::iterator u = values.find(keys.at(i));
+    if (u != values.end() and u.value().deleted) {
+      values.erase(u);
+    }
+  }
+}
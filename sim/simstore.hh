@@ -0,0 +1,29 @@
+#ifndef SIMSTORE_CLASS_HH
+#define SIMSTORE_CLASS_HH
+
+#include <QHash>
+
+#include "storage.hh"
+
+class Simulator;
+
+// Storage of a simulated node, kept in memory. Every version written is
+// reported to the simulator, which measures convergence by them.
+class SimStore : public Storage
+{
+  public:
+    SimStore(Simulator *sim);
+    bool open(QString dir);
+    void put(QString key, int version, QString value);
+    void remove(QString key, int version);
+    QString get(QString key);
+    QHash<QString, int> versions();
+    QStringList tombstones();
+    void purge(const QStringList &keys);
+
+  private:
+    Simulator *sim;
+    QHash<QString, Update> values; // tombstones included
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+
+#include "simulator.hh"
+#include "node.hh"
+
+Simulator::Simulator(const NetworkModel &net)
+{
+  this->net = net;
+  clock = 0;
+  nextSeq = 0;
+  datagrams = 0;
+  bytes = 0;
+  dropped = 0;
+}
+
+Simulator::~Simulator()
+{
+  while (!events.empty()) {
+    delete(events.top());
+    events.pop();
+  }
+  qDeleteAll(transports);
+}
+
+qint64 Simulator::now() const
+{
+  return clock;
+}
+
+// members come as SLOT() or SIGNAL() strings, invokeMethod wants the bare name
+static QByteArray methodName(const char *member)
+{
+  QByteArray name(member + 1);
+  return name.left(name.indexOf('('));
+}
+
+void Simulator::every(int interval, QObject *target, const char *member)
+{
+  Event *event = new Event;
+  event->target = target;
+  event->method = methodName(member);
+  event->interval = qMax(1, interval);
+  event->to = -1;
+  schedule(event, interval);
+}
+
+void Simulator::after(int delay, QObject *target, const char *member)
+{
+  Event *event = new Event;
+  event->target = target;
+  event->method = methodName(member);
+  event->interval = 0;
+  event->to = -1;
+  schedule(event, delay);
+}
+
+void Simulator::schedule(Event *event, qint64 delay)
+{
+  event->time = clock + qMax((qint64)0, delay);
+  event->seq = nextSeq++;
+  events.push(event);
+}
+
+// node joins the network as the next node, listening on peerOf() of its
+// index, returns the transport it is to send through
+Transport *Simulator::addNode(Node *node)
+{
+  transports.append(new SimTransport(this, peerOf(nodes.size())));
+  nodes.append(node);
+  return transports.last();
+}
+
+// nodes are told apart by port, node i listens on port i + 1 of the loopback address
+Peer Simulator::peerOf(int index)
+{
+  return qMakePair(QHostAddress(QHostAddress::LocalHost), index + 1);
+}
+
+int Simulator::indexOf(const Peer &peer)
+{
+  return peer.second - 1;
+}
+
+bool Simulator::reachable(int from, int to) const
+{
+  if (net.partitionGroups < 2 or clock < net.partitionFrom or clock >= net.partitionTo) {
+    return true;
+  }
+  return from % net.partitionGroups == to % net.partitionGroups;
+}
+
+// puts msg on the simulated wire, it arrives after the latency of the
+// network unless it is lost or a partition is in the way
+void Simulator::send(const Peer &from, const Peer &to, const Message &msg)
+{
+  Event *event = new Event;
+  event->datagram = msg.encode();
+  event->from = from;
+  event->to = indexOf(to);
+  event->interval = 0;
+  ++datagrams;
+  bytes += event->datagram.size();
+
+  if (event->to < 0 or event->to >= nodes.size() or
+      !reachable(indexOf(from), event->to) or rand() < net.loss * RAND_MAX) {
+    ++dropped;
+    delete(event);
+    return;
+  }
+  schedule(event, net.latency + (net.jitter > 0 ? rand() % (net.jitter + 1) : 0));
+}
+
+// runs events until the clock would pass until, or nothing is left to run
+void Simulator::run(qint64 until)
+{
+  while (!events.empty() and events.top()->time <= until) {
+    Event *event = events.top();
+    events.pop();
+    clock = event->time;
+
+    if (event->to >= 0) {
+      Message msg;
+      if (msg.decode(event->datagram.constData(), event->datagram.size())) {
+        msg.host = event->from.first;
+        msg.port = event->from.second;
+        nodes.at(event->to)->processMessage(msg);
+      }
+      delete(event);
+    } else if (event->target) {
+      QMetaObject::invokeMethod(event->target, event->method.constData(), Qt::DirectConnection);
+      if (event->interval > 0 and event->target) {
+        schedule(event, event->interval);
+      } else {
+        delete(event);
+      }
+    } else {
+      delete(event);
+    }
+  }
+  clock = qMax(clock, until);
+}
+
+void Simulator::track(const QString &key, int version, int needed)
+{
+  Track t;
+  t.version = version;
+  t.needed = needed;
+  t.holders = 0;
+  t.start = clock;
+  tracked.insert(key, t);
+}
+
+void Simulator::applied(const QString &key, int version)
+{
+  QHash<QString, Track>::iterator t = tracked.find(key);
+  if (t == tracked.end() or t.value().version != version) {
+    return;
+  }
+  if (++t.value().holders >= t.value().needed) {
+    convergence.append(clock - t.value().start);
+    tracked.erase(t);
+  }
+}
+
+int Simulator::unconverged() const
+{
+  return tracked.size();
+}
+
+SimTransport::SimTransport(Simulator *sim, const Peer &address)
+{
+  this->sim = sim;
+  this->address = address;
+}
+
+Peer SimTransport::self() const
+{
+  return address;
+}
+
+void SimTransport::send(const Message &msg, const Peer &peer)
+{
+  sim->send(address, peer, msg);
+}
@@ -0,0 +1,116 @@
+#ifndef SIMULATOR_CLASS_HH
+#define SIMULATOR_CLASS_HH
+
+#include <QByteArray>
+#include <QHash>
+#include <QPointer>
+#include <QVector>
+
+#include <queue>
+#include <vector>
+
+#include "clock.hh"
+#include "message.hh"
+#include "ring.hh"
+#include "transport.hh"
+
+class Node;
+class SimTransport;
+
+// what the simulated network does to datagrams
+struct NetworkModel
+{
+  double loss;          // probability a datagram is dropped
+  int latency;          // ms every datagram takes at least
+  int jitter;           // ms of uniformly random extra delay
+  qint64 partitionFrom; // ms, in between node i only reaches nodes of
+  qint64 partitionTo;   // its group i % partitionGroups
+  int partitionGroups;  // 1 for no partition
+};
+
+// Discrete event simulator of a cluster of Nodes, the virtual clock they
+// run on and the network between them. Events run in order of time, ties
+// in the order they were scheduled, and all randomness comes from rand(),
+// so a run is determined by the seed passed to srand() before it.
+// Datagrams are encoded and decoded like on the wire, and are counted on
+// the way.
+class Simulator : public Clock
+{
+  public:
+    Simulator(const NetworkModel &net);
+    ~Simulator();
+    qint64 now() const;
+    void every(int interval, QObject *target, const char *member);
+    void after(int delay, QObject *target, const char *member);
+
+    Transport *addNode(Node *node);
+    void send(const Peer &from, const Peer &to, const Message &msg);
+    void run(qint64 until);
+
+    // convergence of updates: a tracked version counts as converged once
+    // as many nodes applied it as it needs
+    void track(const QString &key, int version, int needed);
+    void applied(const QString &key, int version);
+    int unconverged() const;
+
+    static Peer peerOf(int index);
+    static int indexOf(const Peer &peer);
+
+    QVector<double> convergence; // ms from put to converged, per converged update
+    quint64 datagrams, bytes, dropped;
+
+  private:
+    struct Event
+    {
+      qint64 time;
+      quint64 seq;
+      QPointer<QObject> target; // a timer, or
+      QByteArray method;
+      int interval;             // 0 for a one shot timer
+      int to;                   // a delivery to node to, -1 for a timer
+      QByteArray datagram;
+      Peer from;
+    };
+
+    struct Later
+    {
+      bool operator()(const Event *a, const Event *b) const
+      {
+        return a->time != b->time ? a->time > b->time : a->seq > b->seq;
+      }
+    };
+
+    struct Track
+    {
+      int version;
+      int needed;  // nodes that have to apply it
+      int holders; // nodes that did so far
+      qint64 start;
+    };
+
+    void schedule(Event *event, qint64 delay);
+    bool reachable(int from, int to) const;
+
+    std::priority_queue<Event *, std::vector<Event *>, Later> events;
+    qint64 clock;
+    quint64 nextSeq;
+    NetworkModel net;
+    QVector<Node *> nodes;
+    QVector<SimTransport *> transports; // of nodes, in the same order
+    QHash<QString, Track> tracked;
+};
+
+// a node's end of the simulated network
+class SimTransport : public Transport
+{
+  public:
+    SimTransport(Simulator *sim, const Peer &address);
+    Peer self() const;
+    void send(const Message &msg, const Peer &peer);
+
+  private:
+    Simulator *sim;
+    Peer address;
+};
+
+#endif
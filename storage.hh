@@ -0,0 +1,48 @@
+#ifndef STORAGE_CLASS_HH
+#define STORAGE_CLASS_HH
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+#include "message.hh"
+
+typedef QList<QPair<QString, Update> > PutBatch;
+
+// local key/value storage of a node
+class Storage
+{
+  public:
+    virtual ~Storage() {}
+    virtual bool open(QString dir) = 0; // false if the store can't be used
+    virtual void put(QString key, int version, QString value) = 0;
+    virtual void remove(QString key, int version) = 0; // stores a tombstone as version of key
+    virtual QString get(QString key) = 0; // empty if the key is unknown or deleted
+    virtual QHash<QString, int> versions() = 0; // newest stored version of every key, tombstones included
+    virtual QStringList tombstones() = 0;       // keys whose newest version is a tombstone
+
+    // forgets the tombstones of keys for good, keys written again since are kept
+    virtual void purge(const QStringList &keys) = 0;
+
+    // stores that can write several puts at once should, in order
+    virtual void putBatch(const PutBatch &batch)
+    {
+      for (int i = 0; i < batch.size(); ++i) {
+        if (batch.at(i).second.deleted) {
+          remove(batch.at(i).first, batch.at(i).second.version);
+        } else {
+          put(batch.at(i).first, batch.at(i).second.version, batch.at(i).second.value);
+        }
+      }
+    }
+    // makes everything put so far survive a crash
+    virtual bool sync() { return true; }
+    // stores that make puts durable later number them, acks of puts wait
+    // until the put of lastTicket() is, see AsyncStore
+    virtual bool defersAcks() const { return false; }
+    virtual quint64 lastTicket() { return 0; }
+};
+
+#endif
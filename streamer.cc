@@ -0,0 +1,210 @@
+#include <QDebug>
+
+#include "streamer.hh"
+#include "netsocket.hh"
+
+Streamer::Streamer(NetSocket *sock)
+{
+  this->sock = sock;
+  // rand() gives at least 15 bits, three of them fill the id
+  nextId = 0;
+  for (int i = 0; i < 3; ++i) {
+    nextId = (nextId << 15) ^ (quint32)rand();
+  }
+  kChunkSize = 1360;      // a chunk header is at most 17 bytes, this stays below 1400
+  kRto = 300;             // ms before an unacked chunk is sent again
+  kMaxTries = 10;
+  kStaleTimeout = 30000;  // ms a silent transfer is kept
+  kMaxSacks = 128;
+  kMinWindow = 4;
+  kMaxWindow = 256;
+  kMaxTransfer = 256 * 1024 * 1024;
+
+  clock.start();
+  timer = new QTimer(this);
+  connect(timer, SIGNAL(timeout()), this, SLOT(tick()));
+  timer->start(50);
+  ackTimer = new QTimer(this);
+  ackTimer->setSingleShot(true);
+  connect(ackTimer, SIGNAL(timeout()), this, SLOT(sendAcks()));
+}
+
+// starts streaming datagram to peer
+void Streamer::send(const QByteArray &datagram, const Peer &peer)
+{
+  if (datagram.size() > kMaxTransfer) {
+    qWarning() << "dropping " << datagram.size() << " byte message, too big to stream";
+    return;
+  }
+
+  OutTransfer t;
+  t.peer = peer;
+  t.data = datagram;
+  t.total = (datagram.size() + kChunkSize - 1) / kChunkSize;
+  t.next = 0;
+  t.tries.fill(0, t.total);
+  t.window = kMinWindow;
+
+  quint32 id = nextId++;
+  outgoing.insert(id, t);
+  pump(outgoing[id], id);
+}
+
+void Streamer::sendChunk(OutTransfer &t, quint32 id, int seq)
+{
+  Message chunk(kMsgChunk);
+  chunk.id = id;
+  chunk.seq = seq;
+  chunk.total = t.total;
+  chunk.payload = t.data.mid(seq * kChunkSize, kChunkSize);
+  sock->sendDatagram(chunk.encode(), t.peer.first, t.peer.second);
+
+  t.unacked.insert(seq, clock.elapsed());
+  ++t.tries[seq];
+}
+
+// sends new chunks while the window has room
+void Streamer::pump(OutTransfer &t, quint32 id)
+{
+  while (t.unacked.size() < (int)t.window and t.next < t.total) {
+    sendChunk(t, id, t.next++);
+  }
+}
+
+// stores a chunk, returns true with the whole datagram once the last one arrived
+bool Streamer::receiveChunk(const Message &msg, QByteArray &datagram)
+{
+  if (msg.total == 0 or msg.seq >= msg.total or msg.payload.isEmpty() or
+      (qint64)msg.total * kChunkSize > kMaxTransfer) {
+    return false;
+  }
+
+  QPair<Peer, quint32> key = qMakePair(qMakePair(msg.host, msg.port), msg.id);
+  QHash<QPair<Peer, quint32>, InTransfer>::iterator i = incoming.find(key);
+  if (i == incoming.end()) {
+    InTransfer t;
+    t.total = msg.total;
+    t.next = 0;
+    t.received = 0;
+    t.chunks.resize(msg.total);
+    t.done = false;
+    i = incoming.insert(key, t);
+  }
+
+  InTransfer &t = i.value();
+  t.lastSeen = clock.elapsed();
+  ackDue.insert(key);
+  if (!ackTimer->isActive()) {
+    ackTimer->start(0);
+  }
+  if (t.done or (int)msg.total != t.total or !t.chunks.at(msg.seq).isEmpty()) {
+    return false;
+  }
+
+  t.chunks[msg.seq] = msg.payload;
+  ++t.received;
+  while (t.next < t.total and !t.chunks.at(t.next).isEmpty()) {
+    ++t.next;
+  }
+  if (t.received < t.total) {
+    return false;
+  }
+
+  datagram.clear();
+  datagram.reserve(t.total * kChunkSize);
+  for (int c = 0; c < t.total; ++c) {
+    datagram.append(t.chunks.at(c));
+  }
+  t.chunks.clear();
+  t.done = true;
+  return true;
+}
+
+// one ack per transfer that got chunks since the last pass
+void Streamer::sendAcks()
+{
+  for (QSet<QPair<Peer, quint32> >::const_iterator k = ackDue.begin(); k != ackDue.end(); ++k) {
+    QHash<QPair<Peer, quint32>, InTransfer>::const_iterator i = incoming.constFind(*k);
+    if (i == incoming.constEnd()) {
+      continue;
+    }
+
+    const InTransfer &t = i.value();
+    Message ack(kMsgChunkAck);
+    ack.id = k->second;
+    ack.seq = t.done ? t.total : t.next;
+    for (int c = t.next + 1; !t.done and c < t.total and ack.sacks.size() < kMaxSacks; ++c) {
+      if (!t.chunks.at(c).isEmpty()) {
+        ack.sacks.append(c);
+      }
+    }
+    sock->sendResponseMessage(ack, k->first.first, k->first.second);
+  }
+  ackDue.clear();
+}
+
+void Streamer::receiveAck(const Message &msg)
+{
+  QHash<quint32, OutTransfer>::iterator i = outgoing.find(msg.id);
+  if (i == outgoing.end() or i.value().peer.first != msg.host or i.value().peer.second != msg.port) {
+    return;
+  }
+
+  OutTransfer &t = i.value();
+  int newlyAcked = 0;
+  while (!t.unacked.isEmpty() and (quint64)t.unacked.firstKey() < msg.seq) {
+    t.unacked.erase(t.unacked.begin());
+    ++newlyAcked;
+  }
+  for (int s = 0; s < msg.sacks.size(); ++s) {
+    newlyAcked += t.unacked.remove(msg.sacks.at(s));
+  }
+
+  if (msg.seq >= (quint64)t.total) {
+    outgoing.erase(i);
+    return;
+  }
+  t.window = qMin(kMaxWindow, t.window + newlyAcked);
+  pump(t, msg.id);
+}
+
+// resends chunks whose ack is overdue and forgets transfers gone quiet
+void Streamer::tick()
+{
+  qint64 now = clock.elapsed();
+
+  QHash<quint32, OutTransfer>::iterator o = outgoing.begin();
+  while (o != outgoing.end()) {
+    OutTransfer &t = o.value();
+    QList<int> overdue;
+    bool failed = false;
+    for (QMap<int, qint64>::const_iterator c = t.unacked.begin(); c != t.unacked.end() and !failed; ++c) {
+      if (now - c.value() >= kRto) {
+        overdue.append(c.key());
+        failed = t.tries.at(c.key()) >= kMaxTries;
+      }
+    }
+
+    if (failed) {
+      qWarning() << "giving up on transfer " << o.key() << " to port " << t.peer.second;
+      o = outgoing.erase(o);
+      continue;
+    }
+    for (int c = 0; c < overdue.size(); ++c) {
+      sendChunk(t, o.key(), overdue.at(c));
+    }
+    if (!overdue.isEmpty()) {
+      t.window = qMax(kMinWindow, t.window / 2);
+    }
+    ++o;
+  }
+
+  QHash<QPair<Peer, quint32>, InTransfer>::iterator i = incoming.begin();
+  while (i != incoming.end()) {
+    if (now - i.value().lastSeen > kStaleTimeout) {
+      i = incoming.erase(i);
+    } else {
+      ++i;
+    }
+  }
+}
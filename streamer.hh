@@ -0,0 +1,79 @@
+#ifndef STREAMER_CLASS_HH
+#define STREAMER_CLASS_HH
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+
+#include "message.hh"
+
+class NetSocket;
+typedef QPair<QHostAddress, int> Peer;
+
+// a datagram being streamed to a peer
+struct OutTransfer
+{
+  Peer peer;
+  QByteArray data;
+  int total;
+  int next;                  // first chunk never sent
+  QMap<int, qint64> unacked; // chunks in flight, with the ms of their last send
+  QVector<int> tries;
+  double window;          // chunks allowed in flight
+};
+
+// a datagram being reassembled from a peer
+struct InTransfer
+{
+  int total;
+  int next;  // first chunk still missing
+  int received;
+  QVector<QByteArray> chunks;
+  qint64 lastSeen;
+  bool done; // kept a while to ack retransmitted chunks
+};
+
+// Sends datagrams too big for the network as numbered kMsgChunk pieces.
+// The receiver acks the chunks it has cumulatively plus a list of the ones
+// past the first gap, once per transfer per pass of the event loop. The
+// sender keeps a window of unacked chunks in flight, grows it by a chunk
+// per ack and halves it when a chunk has to be resent after kRto ms.
+// Transfer ids start at a random number, so that a restarted sender does
+// not reuse the ids of transfers its peers still remember as finished.
+class Streamer : public QObject
+{
+  Q_OBJECT
+
+  public:
+    Streamer(NetSocket *sock);
+    void send(const QByteArray &datagram, const Peer &peer);
+    bool receiveChunk(const Message &msg, QByteArray &datagram);
+    void receiveAck(const Message &msg);
+
+  public slots:
+    void tick();
+    void sendAcks();
+
+  private:
+    void pump(OutTransfer &t, quint32 id);
+    void sendChunk(OutTransfer &t, quint32 id, int seq);
+
+    NetSocket *sock;
+    QHash<quint32, OutTransfer> outgoing;
+    QHash<QPair<Peer, quint32>, InTransfer> incoming;
+    QSet<QPair<Peer, quint32> > ackDue;
+    QTimer *timer;
+    QTimer *ackTimer;
+    QElapsedTimer clock;
+    quint32 nextId;
+
+    int kChunkSize, kRto, kMaxTries, kStaleTimeout, kMaxSacks;
+    double kMinWindow, kMaxWindow;
+    qint64 kMaxTransfer;
+};
+
+#endif
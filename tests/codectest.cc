@@ -0,0 +1,423 @@
+#include <climits>
+
+#include <QtTest>
+
+#include "message.hh"
+
+// Encodes a message of every type, decodes it again and compares every
+// field the type carries, with the values at the edges of the varints.
+// Truncated datagrams and ones of another wire version must be refused.
+
+class CodecTest : public QObject
+{
+  Q_OBJECT
+
+  private slots:
+    void rumor_data();
+    void rumor();
+    void ack();
+    void quorum();
+    void state();
+    void stateReply();
+    void updates();
+    void quorumBatch();
+    void tree();
+    void batch();
+    void chunk();
+    void chunkAck();
+    void ping();
+    void pingReq();
+    void truncated_data();
+    void truncated();
+    void wrongVersion();
+    void unknownType();
+};
+
+static Message roundTrip(const Message &msg)
+{
+  QByteArray datagram = msg.encode();
+  Message out;
+  if (!out.decode(datagram.constData(), datagram.size())) {
+    QTest::qFail("datagram did not decode", __FILE__, __LINE__);
+  }
+  return out;
+}
+
+static Trace trace(quint64 id, qint64 origin, int hops)
+{
+  Trace t;
+  t.id = id;
+  t.origin = origin;
+  t.hops = hops;
+  return t;
+}
+
+static Update update(int version, QString value, bool deleted, const Trace &trace = Trace())
+{
+  Update u;
+  u.version = version;
+  u.value = value;
+  u.deleted = deleted;
+  u.trace = trace;
+  return u;
+}
+
+static Gossip gossip(QString host, int port, quint8 state, quint32 incarnation)
+{
+  Gossip g;
+  g.host = QHostAddress(host);
+  g.port = port;
+  g.state = state;
+  g.incarnation = incarnation;
+  return g;
+}
+
+static void compareUpdates(const UpdateMap &got, const UpdateMap &want)
+{
+  QCOMPARE(got.keys(), want.keys());
+  for (UpdateMap::const_iterator i = want.begin(); i != want.end(); ++i) {
+    const Update &u = got[i.key()];
+    QCOMPARE(u.version, i.value().version);
+    QCOMPARE(u.value, i.value().value);
+    QCOMPARE(u.deleted, i.value().deleted);
+    QCOMPARE(u.trace.id, i.value().trace.id);
+    QCOMPARE(u.trace.origin, i.value().trace.origin);
+    QCOMPARE(u.trace.hops, i.value().trace.hops);
+  }
+}
+
+static void compareMembers(const QList<Gossip> &got, const QList<Gossip> &want)
+{
+  QCOMPARE(got.size(), want.size());
+  for (int i = 0; i < want.size(); ++i) {
+    QCOMPARE(got.at(i).host, want.at(i).host);
+    QCOMPARE(got.at(i).port, want.at(i).port);
+    QCOMPARE(got.at(i).state, want.at(i).state);
+    QCOMPARE(got.at(i).incarnation, want.at(i).incarnation);
+  }
+}
+
+void CodecTest::rumor_data()
+{
+  QTest::addColumn<int>("version");
+  QTest::addColumn<bool>("deleted");
+  QTest::addColumn<quint64>("traceId");
+  QTest::addColumn<QString>("key");
+  QTest::addColumn<QString>("value");
+
+  QTest::newRow("zero") << 0 << false << (quint64)0 << QString() << QString();
+  QTest::newRow("one byte") << 31 << false << (quint64)0 << QString("k") << QString("v");
+  QTest::newRow("two bytes") << 32 << false << (quint64)0 << QString("k") << QString("v");
+  QTest::newRow("largest") << INT_MAX << false << (quint64)0 << QString("k") << QString("v");
+  QTest::newRow("tombstone") << 7 << true << (quint64)0 << QString("gone") << QString();
+  QTest::newRow("traced") << 128 << false << Q_UINT64_C(0xfedcba9876543210)
+                          << QString("k") << QString("v");
+  QTest::newRow("traced tombstone") << 128 << true << (quint64)1 << QString("k") << QString();
+  QTest::newRow("utf-8") << 3 << false << (quint64)0
+                         << QString::fromUtf8("cl\xc3\xa9") << QString::fromUtf8("\xe2\x82\xac");
+  QTest::newRow("long value") << 3 << false << (quint64)0 << QString("k") << QString(20000, 'x');
+}
+
+void CodecTest::rumor()
+{
+  QFETCH(int, version);
+  QFETCH(bool, deleted);
+  QFETCH(quint64, traceId);
+  QFETCH(QString, key);
+  QFETCH(QString, value);
+
+  Message msg(kMsgRumor);
+  msg.version = version;
+  msg.deleted = deleted;
+  msg.key = key;
+  msg.value = value;
+  if (traceId) {
+    msg.trace = trace(traceId, Q_INT64_C(1700000000000), 3);
+  }
+
+  Message got = roundTrip(msg);
+  QCOMPARE((int)got.type, (int)kMsgRumor);
+  QCOMPARE(got.version, version);
+  QCOMPARE(got.deleted, deleted);
+  QCOMPARE(got.key, key);
+  QCOMPARE(got.value, value);
+  QCOMPARE(got.trace.id, msg.trace.id);
+  QCOMPARE(got.trace.origin, msg.trace.origin);
+  QCOMPARE(got.trace.hops, msg.trace.hops);
+}
+
+void CodecTest::ack()
+{
+  Message msg(kMsgAck);
+  msg.ack = kAckNotReplica;
+  msg.version = 128;
+  msg.key = "k";
+  Message got = roundTrip(msg);
+  QCOMPARE(got.ack, (int)kAckNotReplica);
+  QCOMPARE(got.version, 128);
+  QCOMPARE(got.key, QString("k"));
+  QCOMPARE(got.trace.id, (quint64)0);
+
+  msg.ack = kAckFresh;
+  msg.trace.id = Q_UINT64_C(0x8000000000000000);
+  got = roundTrip(msg);
+  QCOMPARE(got.ack, (int)kAckFresh);
+  QCOMPARE(got.trace.id, msg.trace.id);
+}
+
+void CodecTest::quorum()
+{
+  Message call(kMsgQuorumCall);
+  call.id = 0xffffffff;
+  call.version = 127;
+  call.key = "k";
+  Message got = roundTrip(call);
+  QCOMPARE(got.id, (quint32)0xffffffff);
+  QCOMPARE(got.version, 127);
+  QCOMPARE(got.key, QString("k"));
+
+  Message ack(kMsgQuorumAck);
+  ack.id = 128;
+  ack.version = 5;
+  ack.deleted = true;
+  ack.key = "k";
+  got = roundTrip(ack);
+  QCOMPARE(got.id, (quint32)128);
+  QCOMPARE(got.version, 5);
+  QCOMPARE(got.deleted, true);
+  QCOMPARE(got.key, QString("k"));
+  QCOMPARE(got.value, QString());
+}
+
+void CodecTest::state()
+{
+  Message msg(kMsgState);
+  msg.state.insert("a", 0);
+  msg.state.insert("b", 128);
+  msg.state.insert("c", INT_MAX);
+  msg.nodes << 0 << 127 << 128 << 0xffffffff;
+  msg.seq = Q_UINT64_C(0xffffffffffffffff);
+  Message got = roundTrip(msg);
+  QCOMPARE(got.state, msg.state);
+  QCOMPARE(got.nodes, msg.nodes);
+  QCOMPARE(got.seq, msg.seq);
+
+  // an empty state is how a node asks for everything
+  Message empty(kMsgState);
+  got = roundTrip(empty);
+  QVERIFY(got.state.isEmpty());
+  QVERIFY(got.nodes.isEmpty());
+  QCOMPARE(got.seq, (quint64)0);
+}
+
+void CodecTest::stateReply()
+{
+  Message msg(kMsgStateReply);
+  msg.state.insert("a", 1);
+  msg.wanted.insert("b", 2);
+  msg.updates.insert("c", update(3, "value", false));
+  msg.updates.insert("d", update(4, QString(), true));
+  msg.updates.insert("e", update(5, "traced", false, trace(42, 1000, 1)));
+  msg.seq = Q_UINT64_C(1) << 35;
+  Message got = roundTrip(msg);
+  QCOMPARE(got.state, msg.state);
+  QCOMPARE(got.wanted, msg.wanted);
+  compareUpdates(got.updates, msg.updates);
+  QCOMPARE(got.seq, msg.seq);
+}
+
+void CodecTest::updates()
+{
+  const quint8 types[] = { kMsgUpdates, kMsgRumorBatch };
+  for (int t = 0; t < 2; ++t) {
+    quint8 type = types[t];
+    Message msg(type);
+    msg.updates.insert("a", update(0, "zero", false));
+    msg.updates.insert("b", update(INT_MAX, QString(), true, trace(7, 0, 0)));
+    Message got = roundTrip(msg);
+    QCOMPARE((int)got.type, (int)type);
+    compareUpdates(got.updates, msg.updates);
+  }
+}
+
+void CodecTest::quorumBatch()
+{
+  Message call(kMsgQuorumBatchCall);
+  call.id = 9;
+  call.state.insert("a", 1);
+  call.state.insert("b", 0);
+  Message got = roundTrip(call);
+  QCOMPARE(got.id, (quint32)9);
+  QCOMPARE(got.state, call.state);
+
+  Message ack(kMsgQuorumBatchAck);
+  ack.id = 9;
+  ack.updates.insert("a", update(2, "x", false));
+  got = roundTrip(ack);
+  QCOMPARE(got.id, (quint32)9);
+  compareUpdates(got.updates, ack.updates);
+}
+
+void CodecTest::tree()
+{
+  Message msg(kMsgTree);
+  msg.nodes << 1 << 2 << 300;
+  msg.hashes << 0 << Q_UINT64_C(0xffffffffffffffff) << Q_UINT64_C(0x0123456789abcdef);
+  Message got = roundTrip(msg);
+  QCOMPARE(got.nodes, msg.nodes);
+  QCOMPARE(got.hashes, msg.hashes);
+}
+
+void CodecTest::batch()
+{
+  Message rumor(kMsgRumor);
+  rumor.version = 2;
+  rumor.key = "k";
+  rumor.value = "v";
+  Message ack(kMsgAck);
+  ack.ack = kAckKnown;
+  ack.key = "k";
+
+  Message msg(kMsgBatch);
+  msg.parts << rumor.encode() << ack.encode() << QByteArray(200, 'x');
+  Message got = roundTrip(msg);
+  QCOMPARE(got.parts, msg.parts);
+
+  Message part;
+  QVERIFY(part.decode(got.parts.at(0).constData(), got.parts.at(0).size()));
+  QCOMPARE(part.key, QString("k"));
+  QCOMPARE(part.value, QString("v"));
+}
+
+void CodecTest::chunk()
+{
+  Message msg(kMsgChunk);
+  msg.id = 0x80000000;
+  msg.seq = 127;
+  msg.total = 128;
+  msg.payload = QByteArray("\0\x01\x80\xff", 4);
+  Message got = roundTrip(msg);
+  QCOMPARE(got.id, msg.id);
+  QCOMPARE(got.seq, msg.seq);
+  QCOMPARE(got.total, msg.total);
+  QCOMPARE(got.payload, msg.payload);
+
+  // the payload runs to the end of the datagram, an empty one is allowed
+  msg.payload.clear();
+  got = roundTrip(msg);
+  QVERIFY(got.payload.isEmpty());
+}
+
+void CodecTest::chunkAck()
+{
+  Message msg(kMsgChunkAck);
+  msg.id = 1;
+  msg.seq = 16384;
+  msg.sacks << 16386 << 16390;
+  Message got = roundTrip(msg);
+  QCOMPARE(got.id, msg.id);
+  QCOMPARE(got.seq, msg.seq);
+  QCOMPARE(got.sacks, msg.sacks);
+}
+
+void CodecTest::ping()
+{
+  const quint8 types[] = { kMsgPing, kMsgPingAck };
+  for (int t = 0; t < 2; ++t) {
+    quint8 type = types[t];
+    Message msg(type);
+    msg.id = 77;
+    msg.version = 3;
+    msg.members << gossip("127.0.0.1", 45454, 1, 0)
+                << gossip("::1", 65535, 2, 0xffffffff);
+    Message got = roundTrip(msg);
+    QCOMPARE((int)got.type, (int)type);
+    QCOMPARE(got.id, msg.id);
+    QCOMPARE(got.version, msg.version);
+    compareMembers(got.members, msg.members);
+  }
+}
+
+void CodecTest::pingReq()
+{
+  Message msg(kMsgPingReq);
+  msg.id = 78;
+  msg.version = 1;
+  msg.target = gossip("10.0.0.2", 1024, 0, 5);
+  Message got = roundTrip(msg);
+  QCOMPARE(got.id, msg.id);
+  QCOMPARE(got.version, msg.version);
+  compareMembers(QList<Gossip>() << got.target, QList<Gossip>() << msg.target);
+  QVERIFY(got.members.isEmpty());
+}
+
+void CodecTest::truncated_data()
+{
+  QTest::addColumn<QByteArray>("datagram");
+
+  Message rumor(kMsgRumor);
+  rumor.version = 300;
+  rumor.key = "key";
+  rumor.value = "value";
+  rumor.trace = trace(1, 1000, 2);
+  QTest::newRow("rumor") << rumor.encode();
+
+  Message reply(kMsgStateReply);
+  reply.state.insert("a", 1);
+  reply.wanted.insert("b", 2);
+  reply.updates.insert("c", update(3, "value", false));
+  reply.seq = 200;
+  QTest::newRow("state reply") << reply.encode();
+
+  Message tree(kMsgTree);
+  tree.nodes << 1 << 2;
+  tree.hashes << 3 << 4;
+  QTest::newRow("tree") << tree.encode();
+
+  Message ping(kMsgPingReq);
+  ping.id = 1;
+  ping.target = gossip("127.0.0.1", 2000, 0, 1);
+  ping.members << gossip("127.0.0.2", 2001, 0, 1);
+  QTest::newRow("ping request") << ping.encode();
+}
+
+// every field of these types is needed, so every cut short datagram is refused
+void CodecTest::truncated()
+{
+  QFETCH(QByteArray, datagram);
+
+  for (int size = 0; size < datagram.size(); ++size) {
+    Message msg;
+    QVERIFY2(!msg.decode(datagram.constData(), size), qPrintable(QString("cut at %1").arg(size)));
+  }
+}
+
+void CodecTest::wrongVersion()
+{
+  Message rumor(kMsgRumor);
+  rumor.key = "k";
+  QByteArray datagram = rumor.encode();
+  datagram[0] = (char)(Message::kWireVersion - 1);
+  Message msg;
+  QVERIFY(!msg.decode(datagram.constData(), datagram.size()));
+}
+
+void CodecTest::unknownType()
+{
+  QByteArray datagram;
+  datagram.append((char)Message::kWireVersion);
+  datagram.append((char)0xff);
+  Message msg;
+  QVERIFY(!msg.decode(datagram.constData(), datagram.size()));
+
+  // and a batch part that claims more than is left
+  QByteArray batch;
+  batch.append((char)Message::kWireVersion);
+  batch.append((char)kMsgBatch);
+  batch.append((char)5);
+  batch.append("abc");
+  QVERIFY(!msg.decode(batch.constData(), batch.size()));
+}
+
+QTEST_MAIN(CodecTest)
+#include "codectest.moc"
@@ -0,0 +1,14 @@
+# wire format round trip tests, build and run with: qmake && make && ./codectest
+
+TEMPLATE = app
+TARGET = codectest
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+QT += network testlib
+QT -= gui
+
+# Input
+HEADERS += ../message.hh
+SOURCES += codectest.cc ../message.cc
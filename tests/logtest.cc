@@ -0,0 +1,189 @@
+#include <QtTest>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include "logstore.hh"
+
+// Stands in for a node that crashed partway through an append: whatever
+// part of the last record made it to the segment file is left behind,
+// then the log is opened again. Everything appended before the torn record
+// must come back, tombstones included, and the torn bytes must be cut off
+// so that later appends land where a replay finds them.
+
+class LogTest : public QObject
+{
+  Q_OBJECT
+
+  private slots:
+    void tornTail_data();
+    void tornTail();
+    void tornBatch();
+};
+
+static QString segmentPath(const QTemporaryDir &dir)
+{
+  return dir.path() + "/00000000.log";
+}
+
+static qint64 fileSize(const QString &path)
+{
+  return QFileInfo(path).size();
+}
+
+// the bytes of the record a put of key appends, taken from a scratch log
+static QByteArray recordOf(QString key, int version, QString value)
+{
+  QTemporaryDir scratch;
+  {
+    LogStore store;
+    if (!store.open(scratch.path())) {
+      return QByteArray();
+    }
+    store.put(key, version, value);
+  }
+  QFile segment(segmentPath(scratch));
+  if (!segment.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+  return segment.readAll();
+}
+
+static bool appendBytes(const QString &path, const QByteArray &bytes)
+{
+  QFile file(path);
+  return file.open(QIODevice::WriteOnly | QIODevice::Append) and
+         file.write(bytes) == bytes.size();
+}
+
+void LogTest::tornTail_data()
+{
+  QTest::addColumn<QString>("checkpoint");
+  QTest::addColumn<QString>("tear");
+
+  QStringList checkpoints;
+  checkpoints << "none" << "all" << "partial";
+  QStringList tears;
+  tears << "half header" << "header only" << "half value" << "bad crc";
+  for (int c = 0; c < checkpoints.size(); ++c) {
+    for (int t = 0; t < tears.size(); ++t) {
+      QString name = checkpoints.at(c) + ", " + tears.at(t);
+      QTest::newRow(qPrintable(name)) << checkpoints.at(c) << tears.at(t);
+    }
+  }
+}
+
+// checkpoint tells what the log looked like when the crash hit: "none"
+// means no checkpoint was ever written, "all" that it covers every whole
+// record and "partial" that records were appended after it
+void LogTest::tornTail()
+{
+  QFETCH(QString, checkpoint);
+  QFETCH(QString, tear);
+
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  {
+    LogStore store;
+    QVERIFY(store.open(dir.path()));
+    store.put("a", 1, "one");
+    store.put("b", 1, "two");
+    store.remove("b", 2);
+    QVERIFY(store.sync());
+  }
+  if (checkpoint == "none") {
+    QVERIFY(QFile::remove(dir.path() + "/index.ckp"));
+  } else if (checkpoint == "partial") {
+    // never destroyed, so the checkpoint does not cover c
+    LogStore *crashed = new LogStore;
+    QVERIFY(crashed->open(dir.path()));
+    crashed->put("c", 1, "three");
+    QVERIFY(crashed->sync());
+  }
+
+  QByteArray record = recordOf("d", 1, "four");
+  QCOMPARE(record.size(), 16 + 1 + 4);
+  if (tear == "half header") {
+    record.truncate(8);
+  } else if (tear == "header only") {
+    record.truncate(16);
+  } else if (tear == "half value") {
+    record.truncate(record.size() - 2);
+  } else {
+    record[record.size() - 1] = record.at(record.size() - 1) ^ 0x20;
+  }
+  qint64 whole = fileSize(segmentPath(dir));
+  QVERIFY(appendBytes(segmentPath(dir), record));
+
+  {
+    LogStore store;
+    QVERIFY(store.open(dir.path()));
+    QCOMPARE(fileSize(segmentPath(dir)), whole);
+    QCOMPARE(store.get("a"), QString("one"));
+    QCOMPARE(store.get("b"), QString());
+    QCOMPARE(store.tombstones(), QStringList() << "b");
+    QCOMPARE(store.get("d"), QString());
+    QHash<QString, int> versions = store.versions();
+    QCOMPARE(versions.value("a"), 1);
+    QCOMPARE(versions.value("b"), 2);
+    QVERIFY(!versions.contains("d"));
+    if (checkpoint == "partial") {
+      QCOMPARE(store.get("c"), QString("three"));
+      QCOMPARE(versions.size(), 3);
+    } else {
+      QCOMPARE(versions.size(), 2);
+    }
+
+    // the log goes on where the last whole record ended
+    store.put("d", 2, "five");
+    QVERIFY(store.sync());
+  }
+
+  QFile::remove(dir.path() + "/index.ckp");
+  LogStore store;
+  QVERIFY(store.open(dir.path()));
+  QCOMPARE(store.get("a"), QString("one"));
+  QCOMPARE(store.get("d"), QString("five"));
+  QCOMPARE(store.tombstones(), QStringList() << "b");
+}
+
+// a batch goes to disk in a single append, a crash may still leave only
+// its first records behind, those must be kept and the rest dropped
+void LogTest::tornBatch()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  qint64 before;
+  {
+    LogStore store;
+    QVERIFY(store.open(dir.path()));
+    store.put("a", 1, "one");
+    before = fileSize(segmentPath(dir));
+
+    PutBatch batch;
+    for (int i = 1; i <= 3; ++i) {
+      Update u;
+      u.version = 1;
+      u.value = QString("v%1").arg(i);
+      batch.append(qMakePair(QString("k%1").arg(i), u));
+    }
+    store.putBatch(batch);
+    QVERIFY(store.sync());
+  }
+
+  // every record of the batch is 16 + 2 + 2 bytes, cut the second in half
+  QFile::remove(dir.path() + "/index.ckp");
+  QVERIFY(QFile::resize(segmentPath(dir), before + 20 + 10));
+
+  LogStore store;
+  QVERIFY(store.open(dir.path()));
+  QCOMPARE(fileSize(segmentPath(dir)), before + 20);
+  QCOMPARE(store.get("a"), QString("one"));
+  QCOMPARE(store.get("k1"), QString("v1"));
+  QCOMPARE(store.get("k2"), QString());
+  QCOMPARE(store.get("k3"), QString());
+  QCOMPARE(store.versions().size(), 2);
+}
+
+QTEST_MAIN(LogTest)
+#include "logtest.moc"
@@ -0,0 +1,14 @@
+# crash recovery tests of the segment log, build and run with: qmake && make && ./logtest
+
+TEMPLATE = app
+TARGET = logtest
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+QT += network testlib
+QT -= gui
+
+# Input
+HEADERS += ../logstore.hh ../message.hh ../metrics.hh ../storage.hh ../valuecache.hh
+SOURCES += logtest.cc ../logstore.cc ../metrics.cc ../valuecache.cc
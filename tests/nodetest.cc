@@ -0,0 +1,106 @@
+#include <QtTest>
+
+#include <stdlib.h>
+
+#include "node.hh"
+#include "simulator.hh"
+#include "simstore.hh"
+
+// Runs a small cluster of Nodes in the Simulator, on its virtual clock and
+// a lossless network, so that whole protocols can be driven step by step.
+
+class NodeTest : public QObject
+{
+  Q_OBJECT
+
+  private slots:
+    void init();
+    void cleanup();
+    void putAfterCollectedDelete();
+
+  private:
+    void startCluster(int size);
+
+    Simulator *sim;
+    QList<Node *> nodes;
+};
+
+void NodeTest::init()
+{
+  srand(1);
+  NetworkModel net;
+  net.loss = 0;
+  net.latency = 1;
+  net.jitter = 0;
+  net.partitionFrom = 0;
+  net.partitionTo = 0;
+  net.partitionGroups = 1;
+  sim = new Simulator(net);
+}
+
+void NodeTest::cleanup()
+{
+  qDeleteAll(nodes);
+  nodes.clear();
+  delete(sim);
+}
+
+// every node of the cluster holds every key
+void NodeTest::startCluster(int size)
+{
+  QList<Peer> members;
+  for (int n = 0; n < size; ++n) {
+    members.append(Simulator::peerOf(n));
+  }
+  for (int n = 0; n < size; ++n) {
+    Node *node = new Node(sim);
+    node->replicationFactor = size;
+    QVERIFY(node->start(sim->addNode(node), new SimStore(sim), members));
+    nodes.append(node);
+  }
+}
+
+// A key deleted and collected everywhere is put again while one replica
+// still holds the tombstone, as a replica that lagged behind would. The
+// new value must get past the tombstone on every replica.
+void NodeTest::putAfterCollectedDelete()
+{
+  startCluster(2);
+  nodes.at(0)->putRequest("key", "old");
+  sim->run(1000);
+  QCOMPARE(nodes.at(1)->peekRequest("key"), QString("old"));
+
+  nodes.at(0)->deleteRequest("key");
+  sim->run(2000);
+  int buried = nodes.at(1)->vt->findVersion("key");
+  QVERIFY(buried > 0);
+  QCOMPARE(nodes.at(1)->death->size(), 1);
+
+  // well past the expiration of the tombstone and a few sweeps after it
+  sim->run(180000);
+  for (int n = 0; n < nodes.size(); ++n) {
+    QCOMPARE(nodes.at(n)->death->size(), 0);
+    QCOMPARE(nodes.at(n)->vt->findVersion("key"), 0);
+  }
+
+  // the tombstone comes back to node 1 by a late update
+  Message late(kMsgUpdates);
+  Update u;
+  u.version = buried;
+  u.deleted = true;
+  late.updates.insert("key", u);
+  late.host = Simulator::peerOf(0).first;
+  late.port = Simulator::peerOf(0).second;
+  nodes.at(1)->processMessage(late);
+  QCOMPARE(nodes.at(1)->vt->findVersion("key"), buried);
+
+  nodes.at(0)->putRequest("key", "new");
+  sim->run(sim->now() + 1000);
+  QVERIFY(nodes.at(0)->vt->findVersion("key") > buried);
+  for (int n = 0; n < nodes.size(); ++n) {
+    QCOMPARE(nodes.at(n)->peekRequest("key"), QString("new"));
+  }
+}
+
+QTEST_MAIN(NodeTest)
+#include "nodetest.moc"
@@ -0,0 +1,23 @@
+# tests of whole nodes run in the simulator, build and run with: qmake && make && ./nodetest
+
+TEMPLATE = app
+TARGET = nodetest
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEPENDPATH += . .. ../sim
+INCLUDEPATH += . .. ../sim
+QT += network testlib
+QT -= gui
+
+# Input
+HEADERS += ../sim/simulator.hh ../sim/simstore.hh ../node.hh ../transport.hh ../clock.hh \
+           ../storage.hh ../netsocket.hh ../streamer.hh ../membership.hh ../message.hh \
+           ../merkle.hh ../ring.hh ../versiontable.hh ../versiontracker.hh ../valuecache.hh \
+           ../logstore.hh ../asyncstore.hh ../mpscqueue.hh ../receiver.hh ../timerwheel.hh \
+           ../hotrumor.hh ../gossip.hh ../death.hh ../quorum.hh ../metrics.hh ../tracer.hh \
+           ../lease.hh
+SOURCES += nodetest.cc ../sim/simulator.cc ../sim/simstore.cc ../node.cc ../clock.cc \
+           ../netsocket.cc ../streamer.cc ../membership.cc ../message.cc ../merkle.cc \
+           ../ring.cc ../versiontable.cc ../versiontracker.cc ../valuecache.cc ../logstore.cc \
+           ../asyncstore.cc ../receiver.cc ../timerwheel.cc ../hotrumor.cc ../gossip.cc \
+           ../death.cc ../quorum.cc ../metrics.cc ../tracer.cc ../lease.cc
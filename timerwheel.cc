@@ -0,0 +1,45 @@
+#include "timerwheel.hh"
+
+TimerWheel::TimerWheel(int size, int tick)
+{
+  buckets.resize(size);
+  cursor = 0;
+  kTick = tick;
+}
+
+int TimerWheel::tick() const
+{
+  return kTick;
+}
+
+// schedules key to expire delay ms from now, rounded to whole ticks
+void TimerWheel::schedule(const QString &key, quint64 id, int delay)
+{
+  int ticks = qMax(1, delay / kTick);
+  Entry e;
+  e.key = key;
+  e.id = id;
+  e.rounds = (ticks - 1) / buckets.size();
+  buckets[(cursor + ticks) % buckets.size()].append(e);
+}
+
+// moves to the next slot and returns the <key, id> entries that expired
+QList<QPair<QString, quint64> > TimerWheel::advance()
+{
+  QList<QPair<QString, quint64> > due;
+  cursor = (cursor + 1) % buckets.size();
+
+  QList<Entry> &slot = buckets[cursor];
+  QList<Entry> waiting;
+  for (int i = 0; i < slot.size(); ++i) {
+    if (slot.at(i).rounds > 0) {
+      Entry e = slot.at(i);
+      --e.rounds;
+      waiting.append(e);
+    } else {
+      due.append(qMakePair(slot.at(i).key, slot.at(i).id));
+    }
+  }
+  slot = waiting;
+  return due;
+}
@@ -0,0 +1,35 @@
+#ifndef TIMERWHEEL_CLASS_HH
+#define TIMERWHEEL_CLASS_HH
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+// Hashed timer wheel of size buckets, one per tick of kTick ms.
+// An entry due in t ticks goes into bucket (cursor + t) % size with the
+// number of full turns it has to wait, so scheduling and expiring are O(1)
+// no matter how many entries are pending. Entries are never cancelled, the
+// owner checks the id of an expired entry against its current state instead.
+class TimerWheel
+{
+  public:
+    TimerWheel(int size, int tick);
+    void schedule(const QString &key, quint64 id, int delay);
+    QList<QPair<QString, quint64> > advance();
+    int tick() const;
+
+  private:
+    struct Entry
+    {
+      QString key;
+      quint64 id;
+      int rounds;
+    };
+
+    QVector<QList<Entry> > buckets;
+    int cursor;
+    int kTick; // ms per slot
+};
+
+#endif
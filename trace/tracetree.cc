@@ -0,0 +1,289 @@
+#include <iostream>
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+// Joins the trace logs the nodes of a cluster wrote with --trace-log into
+// one propagation tree per traced update: who put it, which node every
+// other node first got it from, by rumor, anti-entropy or batch, after how
+// many hops and ms, and where rumor mongering gave up on it. Reports how
+// the arrivals split over the paths and their delays as JSON, or prints
+// the trees of the slowest updates with --trees.
+//
+// Delays are taken on the clock of the receiving node against the clock of
+// the origin, across hosts they are only as good as the clock sync.
+
+// one line of a trace log
+struct Event
+{
+  qint64 time;
+  QString id;
+  QString event;
+  QString node;
+  QString from;
+  int version;
+  int hops;
+  qint64 delay;
+  QString key;
+};
+
+// how an update first got to a node
+struct Arrival
+{
+  QString path;
+  QString from;
+  int hops;
+  qint64 delay;
+};
+
+struct Traced
+{
+  Traced() : version(0), duplicates(0), lastStop(-1) {}
+
+  QString key;
+  int version;
+  QString origin;                 // node it was put at, empty if that log is missing
+  QMap<QString, Arrival> arrivals; // by node, the origin excluded
+  int duplicates;
+  qint64 lastStop;                // ms until the last node gave up its rumor, -1 if none did
+
+  qint64 slowest() const
+  {
+    qint64 out = 0;
+    for (QMap<QString, Arrival>::const_iterator i = arrivals.begin(); i != arrivals.end(); ++i) {
+      out = qMax(out, i.value().delay);
+    }
+    return out;
+  }
+};
+
+struct Options
+{
+  QStringList logs;
+  int trees;
+  QString out;
+};
+
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog << " [--trees N] [--out FILE] LOG..." << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, Options &opt)
+{
+  opt.trees = 0;
+  for (int i = 1; i < argc; ++i) {
+    QString arg = argv[i];
+    if (arg == "--trees" and i + 1 < argc) {
+      opt.trees = qMax(1, QString(argv[++i]).toInt());
+    } else if (arg == "--out" and i + 1 < argc) {
+      opt.out = argv[++i];
+    } else if (arg.startsWith("--")) {
+      return false;
+    } else {
+      opt.logs.append(arg);
+    }
+  }
+  return !opt.logs.isEmpty();
+}
+
+// TIME ID EVENT NODE FROM VERSION HOPS DELAY KEY, the key may hold spaces
+static bool parseLine(const QString &line, Event &e)
+{
+  QStringList fields = line.split(' ');
+  if (fields.size() < 9) {
+    return false;
+  }
+  bool ok = true, good;
+  e.time = fields.at(0).toLongLong(&good);
+  ok = ok and good;
+  e.id = fields.at(1);
+  e.event = fields.at(2);
+  e.node = fields.at(3);
+  e.from = fields.at(4);
+  e.version = fields.at(5).toInt(&good);
+  ok = ok and good;
+  e.hops = fields.at(6).toInt(&good);
+  ok = ok and good;
+  e.delay = fields.at(7).toLongLong(&good);
+  ok = ok and good;
+  e.key = line.section(' ', 8);
+  return ok;
+}
+
+static void add(QHash<QString, Traced> &traces, const Event &e)
+{
+  Traced &t = traces[e.id];
+  t.key = e.key;
+  t.version = e.version;
+  if (e.event == "put") {
+    t.origin = e.node;
+  } else if (e.event == "rumor" or e.event == "entropy" or e.event == "batch") {
+    // a node applies a version once, a second arrival would be a restart
+    if (!t.arrivals.contains(e.node) or e.delay < t.arrivals.value(e.node).delay) {
+      Arrival a;
+      a.path = e.event;
+      a.from = e.from;
+      a.hops = e.hops;
+      a.delay = e.delay;
+      t.arrivals.insert(e.node, a);
+    }
+  } else if (e.event == "duplicate") {
+    ++t.duplicates;
+  } else if (e.event == "stopped") {
+    t.lastStop = qMax(t.lastStop, e.delay);
+  }
+}
+
+static double percentile(QVector<double> samples, double p)
+{
+  if (samples.isEmpty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  int i = qMin(samples.size() - 1, (int)(p * samples.size()));
+  return samples.at(i);
+}
+
+static QString json(const QString &name, double value)
+{
+  return QString("\"%1\": %2").arg(name).arg(value, 0, 'f', 3);
+}
+
+// the nodes that got the update from node, under it, in arrival order
+static void printTree(QTextStream &out, const Traced &t, const QString &node, int depth)
+{
+  QList<QPair<qint64, QString> > children;
+  for (QMap<QString, Arrival>::const_iterator i = t.arrivals.begin(); i != t.arrivals.end(); ++i) {
+    if (i.value().from == node) {
+      children.append(qMakePair(i.value().delay, i.key()));
+    }
+  }
+  std::sort(children.begin(), children.end());
+  for (int i = 0; i < children.size(); ++i) {
+    const Arrival &a = t.arrivals[children.at(i).second];
+    out << QString(2 * depth, ' ') << children.at(i).second << "  +" << a.delay << " ms  "
+        << a.path << ", hop " << a.hops << "\n";
+    if (depth < 64) {
+      printTree(out, t, children.at(i).second, depth + 1);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  QCoreApplication app(argc, argv);
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  QHash<QString, Traced> traces;
+  int bad = 0;
+  for (int i = 0; i < opt.logs.size(); ++i) {
+    QFile file(opt.logs.at(i));
+    if (!file.open(QIODevice::ReadOnly)) {
+      std::cerr << "could not open " << opt.logs.at(i).toStdString() << std::endl;
+      return 1;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+      Event e;
+      if (parseLine(in.readLine(), e)) {
+        add(traces, e);
+      } else {
+        ++bad;
+      }
+    }
+  }
+
+  if (opt.trees > 0) {
+    QList<QPair<qint64, QString> > slowest;
+    for (QHash<QString, Traced>::const_iterator i = traces.begin(); i != traces.end(); ++i) {
+      slowest.append(qMakePair(-i.value().slowest(), i.key()));
+    }
+    std::sort(slowest.begin(), slowest.end());
+
+    QTextStream out(stdout);
+    for (int i = 0; i < qMin(opt.trees, slowest.size()); ++i) {
+      const Traced &t = traces[slowest.at(i).second];
+      out << "trace " << slowest.at(i).second << " key " << t.key << " version " << t.version
+          << ", " << t.duplicates << " duplicates";
+      if (t.lastStop >= 0) {
+        out << ", rumors stopped by +" << t.lastStop << " ms";
+      }
+      out << "\n" << (t.origin.isEmpty() ? QString("?") : t.origin) << "  put\n";
+      printTree(out, t, t.origin, 1);
+
+      // subtrees of senders that left no log, hung off the root
+      QSet<QString> senders;
+      for (QMap<QString, Arrival>::const_iterator a = t.arrivals.begin(); a != t.arrivals.end(); ++a) {
+        if (a.value().from != t.origin and !t.arrivals.contains(a.value().from)) {
+          senders.insert(a.value().from);
+        }
+      }
+      for (QSet<QString>::const_iterator s = senders.begin(); s != senders.end(); ++s) {
+        out << "  " << *s << "  (no log)\n";
+        printTree(out, t, *s, 2);
+      }
+    }
+    return 0;
+  }
+
+  QMap<QString, QVector<double> > delays; // by path
+  QVector<double> all, hops;
+  int duplicates = 0, repaired = 0, gaveUp = 0;
+  for (QHash<QString, Traced>::const_iterator i = traces.begin(); i != traces.end(); ++i) {
+    const Traced &t = i.value();
+    bool byEntropy = false;
+    for (QMap<QString, Arrival>::const_iterator a = t.arrivals.begin(); a != t.arrivals.end(); ++a) {
+      delays[a.value().path].append(a.value().delay);
+      all.append(a.value().delay);
+      hops.append(a.value().hops);
+      byEntropy = byEntropy or a.value().path == "entropy";
+    }
+    duplicates += t.duplicates;
+    repaired += byEntropy ? 1 : 0;
+    // rumor mongering was over before the update reached everyone it reached
+    gaveUp += (t.lastStop >= 0 and t.lastStop < t.slowest()) ? 1 : 0;
+  }
+
+  QStringList fields;
+  fields << json("traces", traces.size()) << json("arrivals", all.size())
+         << json("bad_lines", bad)
+         << json("delay_ms_p50", percentile(all, 0.5))
+         << json("delay_ms_p99", percentile(all, 0.99))
+         << json("delay_ms_max", percentile(all, 1.0))
+         << json("hops_p50", percentile(hops, 0.5))
+         << json("hops_max", percentile(hops, 1.0))
+         << json("duplicates_per_trace", (double)duplicates / qMax(1, traces.size()));
+  QStringList paths = QStringList() << "rumor" << "batch" << "entropy";
+  for (int i = 0; i < paths.size(); ++i) {
+    const QVector<double> &d = delays.value(paths.at(i));
+    fields << json(paths.at(i) + "_arrivals", d.size())
+           << json(paths.at(i) + "_delay_ms_p50", percentile(d, 0.5))
+           << json(paths.at(i) + "_delay_ms_p99", percentile(d, 0.99));
+  }
+  fields << json("traces_repaired_by_entropy", repaired)
+         << json("traces_rumor_stopped_early", gaveUp);
+  QByteArray report = ("{\n  " + fields.join(",\n  ") + "\n}\n").toUtf8();
+
+  if (opt.out.isEmpty()) {
+    std::cout << report.constData();
+  } else {
+    QFile file(opt.out);
+    if (!file.open(QIODevice::WriteOnly) or file.write(report) != report.size()) {
+      std::cerr << "could not write " << opt.out.toStdString() << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,13 @@
+# joins the trace logs of a cluster, build with: qmake && make
+# and run ./tracetree node1.trace node2.trace ... (see --help)
+
+TEMPLATE = app
+TARGET = tracetree
+CONFIG += console
+CONFIG -= app_bundle
+DEPENDPATH += .
+INCLUDEPATH += .
+QT -= gui
+
+# Input
+SOURCES += tracetree.cc
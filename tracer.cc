@@ -0,0 +1,118 @@
+#include <stdlib.h>
+
+#include <QDateTime>
+#include <QDebug>
+
+#include "tracer.hh"
+
+Tracer::Tracer(const Peer &self, int sample, Clock *clock)
+{
+  this->self = self;
+  this->clock = clock;
+  kSample = sample;        // 0 to start no traces here
+  kHold = 60000;
+  kSweepInterval = 10000;
+  clock->every(kSweepInterval, this, SLOT(sweep()));
+}
+
+// appends events to the file at path from now on
+bool Tracer::open(const QString &path)
+{
+  log.setFileName(path);
+  if (!log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    qWarning() << "could not open trace log " << path << ": " << log.errorString();
+    return false;
+  }
+  return true;
+}
+
+// a new trace for a put made here, or none if the put is not sampled
+Trace Tracer::start()
+{
+  Trace trace;
+  if (kSample <= 0 or rand() % kSample != 0) {
+    return trace;
+  }
+  // rand() gives at least 15 bits, five of them fill the id
+  for (int i = 0; i < 5; ++i) {
+    trace.id = (trace.id << 15) ^ (quint64)rand();
+  }
+  trace.id = trace.id ? trace.id : 1;
+  trace.origin = QDateTime::currentMSecsSinceEpoch();
+  return trace;
+}
+
+static QString peerName(const Peer &peer)
+{
+  return peer.first.isNull() ? QString("-") : QString("%1:%2").arg(peer.first.toString()).arg(peer.second);
+}
+
+// logs event, an update that arrived or was put here is remembered for forward()
+void Tracer::record(TraceEvent event, const QString &key, int version, const Trace &given,
+                    const Peer &from)
+{
+  static const char *names[] = {
+    "put", "rumor", "entropy", "batch", "duplicate", "acked", "known", "stopped"
+  };
+
+  // acks carry the id only, the rest is what this node holds of the trace
+  Trace trace = given;
+  QHash<QString, Held>::const_iterator i = held.constFind(key);
+  if (!trace.origin and i != held.constEnd() and i.value().trace.id == trace.id) {
+    trace = i.value().trace;
+  }
+
+  if (event <= kTraceBatch) {
+    Held h;
+    h.version = version;
+    h.trace = trace;
+    h.since = clock->now();
+    held.insert(key, h);
+  }
+  if (!log.isOpen()) {
+    return;
+  }
+
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  QString line = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n")
+                 .arg(now)
+                 .arg(trace.id, 16, 16, QChar('0'))
+                 .arg(names[event])
+                 .arg(peerName(self))
+                 .arg(peerName(from))
+                 .arg(version)
+                 .arg(trace.hops)
+                 .arg(now - trace.origin)
+                 .arg(key);
+  log.write(line.toUtf8());
+}
+
+// the trace to send version of key on with, one hop further than it came
+Trace Tracer::forward(const QString &key, int version) const
+{
+  QHash<QString, Held>::const_iterator i = held.constFind(key);
+  if (i == held.constEnd() or i.value().version != version) {
+    return Trace();
+  }
+  Trace trace = i.value().trace;
+  ++trace.hops;
+  return trace;
+}
+
+// forgets the traces of updates that should have spread by now, and
+// writes out the lines the log buffered since the last sweep
+void Tracer::sweep()
+{
+  if (log.isOpen()) {
+    log.flush();
+  }
+
+  qint64 now = clock->now();
+  for (QHash<QString, Held>::iterator i = held.begin(); i != held.end(); ) {
+    if (now - i.value().since > kHold) {
+      i = held.erase(i);
+    } else {
+      ++i;
+    }
+  }
+}
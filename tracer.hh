@@ -0,0 +1,68 @@
+#ifndef TRACER_CLASS_HH
+#define TRACER_CLASS_HH
+
+#include <QFile>
+#include <QHash>
+#include <QObject>
+
+#include "clock.hh"
+#include "message.hh"
+
+typedef QPair<QHostAddress, int> Peer;
+
+// what happened to a traced update at a node
+enum TraceEvent
+{
+  kTracePut,       // it was put here, the root of its propagation tree
+  kTraceRumor,     // it arrived as a hot rumor
+  kTraceEntropy,   // it arrived with anti-entropy
+  kTraceBatch,     // it arrived in a rumor batch
+  kTraceDuplicate, // a rumor of it arrived that was known already
+  kTraceAcked,     // a replica took a rumor of it
+  kTraceKnown,     // a replica acked a rumor of it that it knew already
+  kTraceStopped    // rumor mongering gave up on it here
+};
+
+// Follows a sample of the updates through the cluster. One put in kSample
+// made here starts a trace, which the update carries along in rumors,
+// batches and anti-entropy, and every node appends what happens to it to
+// its trace log, one line per event:
+//
+//   TIME ID EVENT NODE FROM VERSION HOPS DELAY KEY
+//
+// with TIME and DELAY, the ms since the put, taken from the wall clock of
+// the node. trace/tracetree joins the logs of all nodes into trees.
+// A node remembers the trace of each key it learned for kHold ms, so
+// anti-entropy can pass it on as well. The log is written out every
+// kSweepInterval ms, and when the tracer goes away with its node.
+class Tracer : public QObject
+{
+  Q_OBJECT
+
+  public:
+    Tracer(const Peer &self, int sample, Clock *clock = Clock::wall());
+    bool open(const QString &path);
+    Trace start();
+    void record(TraceEvent event, const QString &key, int version, const Trace &trace,
+                const Peer &from = Peer());
+    Trace forward(const QString &key, int version) const;
+
+  public slots:
+    void sweep();
+
+  private:
+    struct Held
+    {
+      int version;
+      Trace trace;
+      qint64 since;
+    };
+
+    QHash<QString, Held> held;
+    QFile log;
+    Peer self;
+    Clock *clock;
+    int kSample, kHold, kSweepInterval;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef TRANSPORT_CLASS_HH
+#define TRANSPORT_CLASS_HH
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QPair>
+
+#include "message.hh"
+
+typedef QPair<QHostAddress, int> Peer;
+
+// How a node reaches the other nodes, a NetSocket on a real network or the
+// network of a Simulator. What arrives is handed to Node::processMessage.
+class Transport
+{
+  public:
+    virtual ~Transport() {}
+    virtual Peer self() const = 0; // where the other nodes reach this one
+    virtual void send(const Message &msg, const Peer &peer) = 0;
+    virtual bool congested() const { return false; } // low priority traffic should wait
+
+    // transports that split messages too big for a datagram into chunks
+    // put them back together, true once datagram holds the whole message
+    virtual bool receiveChunk(const Message &chunk, QByteArray &datagram)
+    {
+      Q_UNUSED(chunk);
+      Q_UNUSED(datagram);
+      return false;
+    }
+    virtual void receiveChunkAck(const Message &ack) { Q_UNUSED(ack); }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "valuecache.hh"
+
+ValueCache::ValueCache(qint64 budget)
+{
+  kBudget = budget;
+  hand = 0;
+  used = 0;
+}
+
+// bytes an entry is charged, its characters plus what the hash and the
+// strings cost around them
+int ValueCache::costOf(const QString &key, const QString &value)
+{
+  return 2 * (key.size() + value.size()) + 96;
+}
+
+// the value of key if the cache holds it
+bool ValueCache::get(const QString &key, QString &value)
+{
+  QHash<QString, int>::const_iterator i = slotOf.constFind(key);
+  if (i == slotOf.constEnd()) {
+    return false;
+  }
+
+  Entry &e = entries[i.value()];
+  e.used = true;
+  value = e.value;
+  return true;
+}
+
+// remembers value as the value of key, replacing the one held before
+void ValueCache::put(const QString &key, const QString &value)
+{
+  int cost = costOf(key, value);
+  QHash<QString, int>::const_iterator i = slotOf.constFind(key);
+  if (i != slotOf.constEnd()) {
+    drop(i.value());
+  }
+  if (cost > kBudget / 8) {
+    // one huge value would flush everything else
+    return;
+  }
+  evict(cost);
+
+  Entry e;
+  e.key = key;
+  e.value = value;
+  e.cost = cost;
+  e.used = false;
+  int slot;
+  if (!spare.isEmpty()) {
+    slot = spare.last();
+    spare.removeLast();
+    entries[slot] = e;
+  } else {
+    slot = entries.size();
+    entries.append(e);
+  }
+  slotOf.insert(key, slot);
+  used += cost;
+}
+
+void ValueCache::remove(const QString &key)
+{
+  QHash<QString, int>::const_iterator i = slotOf.constFind(key);
+  if (i != slotOf.constEnd()) {
+    drop(i.value());
+  }
+}
+
+void ValueCache::drop(int slot)
+{
+  Entry &e = entries[slot];
+  slotOf.remove(e.key);
+  used -= e.cost;
+  e.key = QString();
+  e.value = QString();
+  e.cost = 0;
+  spare.append(slot);
+}
+
+// sweeps the hand until needed more bytes fit in the budget
+void ValueCache::evict(qint64 needed)
+{
+  while (used + needed > kBudget and !slotOf.isEmpty()) {
+    hand = (hand + 1) % entries.size();
+    Entry &e = entries[hand];
+    if (e.cost == 0) {
+      continue;
+    }
+    if (e.used) {
+      e.used = false;
+    } else {
+      drop(hand);
+    }
+  }
+}
+
+qint64 ValueCache::bytes() const
+{
+  return used;
+}
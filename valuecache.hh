@@ -0,0 +1,43 @@
+#ifndef VALUECACHE_CLASS_HH
+#define VALUECACHE_CLASS_HH
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Values of recently read or written keys, at most kBudget bytes of them.
+// Eviction is CLOCK: a hand sweeps the entries, an entry used since the
+// hand last passed gets another round, any other is dropped. Not thread
+// safe, the owner locks around it and keeps every entry the newest value
+// of its key, so a hit needs no other lookup.
+class ValueCache
+{
+  public:
+    ValueCache(qint64 budget);
+    bool get(const QString &key, QString &value);
+    void put(const QString &key, const QString &value);
+    void remove(const QString &key);
+
+    qint64 bytes() const;
+
+  private:
+    struct Entry
+    {
+      QString key;
+      QString value;
+      int cost;
+      bool used;
+    };
+
+    static int costOf(const QString &key, const QString &value);
+    void evict(qint64 needed);
+    void drop(int slot);
+
+    QHash<QString, int> slotOf;
+    QVector<Entry> entries;
+    QVector<int> spare; // empty entries to reuse
+    int hand;
+    qint64 used, kBudget;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include <string.h>
+
+#include "versiontable.hh"
+
+// 32 bit fnv-1a over the UTF-16 characters, with a final mix so that the
+// low bits used for the slot are spread well
+static quint32 keyHash(const QString &key)
+{
+  const ushort *p = key.utf16();
+  quint32 h = 0x811c9dc5;
+  for (int i = 0; i < key.size(); ++i) {
+    h ^= p[i];
+    h *= 0x01000193;
+  }
+  h ^= h >> 16;
+  h *= 0x7feb352d;
+  h ^= h >> 15;
+  return h;
+}
+
+VersionTable::VersionTable(int buckets)
+{
+  this->buckets.fill(-1, buckets);
+  table.fill(0, 16);
+  mask = 15;
+  head = -1;
+  tail = -1;
+  seq = 0;
+  deadChars = 0;
+}
+
+int VersionTable::size() const
+{
+  return entries.size();
+}
+
+QString VersionTable::keyAt(int i) const
+{
+  const Entry &e = entries.at(i);
+  return QString((const QChar *)chars.constData() + e.offset, e.length);
+}
+
+int VersionTable::versionAt(int i) const
+{
+  return entries.at(i).version;
+}
+
+quint64 VersionTable::seqAt(int i) const
+{
+  return entries.at(i).seq;
+}
+
+int VersionTable::oldest() const
+{
+  return head;
+}
+
+int VersionTable::newest() const
+{
+  return tail;
+}
+
+int VersionTable::newer(int i) const
+{
+  return entries.at(i).newer;
+}
+
+int VersionTable::older(int i) const
+{
+  return entries.at(i).older;
+}
+
+quint64 VersionTable::lastSeq() const
+{
+  return seq;
+}
+
+int VersionTable::firstIn(quint32 bucket) const
+{
+  return buckets.at(bucket);
+}
+
+int VersionTable::nextIn(int i) const
+{
+  return entries.at(i).nextInBucket;
+}
+
+// points whatever leads to entry i in its bucket at entry to instead
+void VersionTable::relink(int i, int to)
+{
+  qint32 *link = &buckets[entries.at(i).bucket];
+  while (*link != i) {
+    link = &entries[*link].nextInBucket;
+  }
+  *link = to;
+}
+
+void VersionTable::unlink(int i)
+{
+  Entry &e = entries[i];
+  if (e.older >= 0) {
+    entries[e.older].newer = e.newer;
+  } else {
+    head = e.newer;
+  }
+  if (e.newer >= 0) {
+    entries[e.newer].older = e.older;
+  } else {
+    tail = e.older;
+  }
+}
+
+// makes entry i the newest change
+void VersionTable::append(int i)
+{
+  Entry &e = entries[i];
+  e.seq = ++seq;
+  e.older = tail;
+  e.newer = -1;
+  if (tail >= 0) {
+    entries[tail].newer = i;
+  } else {
+    head = i;
+  }
+  tail = i;
+}
+
+// slot holding key, or the empty slot where it would go
+int VersionTable::find(const QString &key, quint32 hash) const
+{
+  quint32 s = hash & mask;
+  while (table.at(s)) {
+    const Entry &e = entries.at(table.at(s) - 1);
+    if (e.hash == hash and e.length == (quint32)key.size() and
+        memcmp(chars.constData() + e.offset, key.utf16(), e.length * sizeof(ushort)) == 0) {
+      break;
+    }
+    s = (s + 1) & mask;
+  }
+  return s;
+}
+
+// version of key, defaultVersion if it has none
+int VersionTable::value(const QString &key, int defaultVersion) const
+{
+  quint32 slot = table.at(find(key, keyHash(key)));
+  return slot ? entries.at(slot - 1).version : defaultVersion;
+}
+
+// sets the version of key, a new key goes into bucket
+void VersionTable::insert(const QString &key, int version, quint32 bucket)
+{
+  quint32 hash = keyHash(key);
+  int s = find(key, hash);
+  if (table.at(s)) {
+    int i = table.at(s) - 1;
+    entries[i].version = version;
+    unlink(i);
+    append(i);
+    return;
+  }
+
+  Entry e;
+  e.hash = hash;
+  e.offset = chars.size();
+  e.length = key.size();
+  e.version = version;
+  e.bucket = bucket;
+  e.nextInBucket = buckets.at(bucket);
+  chars.resize(e.offset + e.length);
+  memcpy(chars.data() + e.offset, key.utf16(), e.length * sizeof(ushort));
+  entries.append(e);
+  table[s] = entries.size();
+  append(entries.size() - 1);
+  buckets[bucket] = entries.size() - 1;
+
+  // stay under 3/4 full so probes stay short
+  if ((quint32)entries.size() * 4 > (mask + 1) * 3) {
+    grow();
+  }
+}
+
+// forgets key, returns false if it was not there
+bool VersionTable::remove(const QString &key)
+{
+  quint32 s = find(key, keyHash(key));
+  if (!table.at(s)) {
+    return false;
+  }
+  int i = table.at(s) - 1;
+  unlink(i);
+  relink(i, entries.at(i).nextInBucket);
+
+  // shifts the entries probed past the slot back, so no probe runs into a hole
+  quint32 hole = s;
+  for (quint32 next = (hole + 1) & mask; table.at(next); next = (next + 1) & mask) {
+    quint32 home = entries.at(table.at(next) - 1).hash & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      table[hole] = table.at(next);
+      hole = next;
+    }
+  }
+  table[hole] = 0;
+
+  deadChars += entries.at(i).length;
+  int last = entries.size() - 1;
+  if (i != last) {
+    relink(last, i);
+    Entry &e = entries[i];
+    e = entries.at(last);
+    quint32 slot = e.hash & mask;
+    while (table.at(slot) != (quint32)last + 1) {
+      slot = (slot + 1) & mask;
+    }
+    table[slot] = i + 1;
+    if (e.older >= 0) {
+      entries[e.older].newer = i;
+    } else {
+      head = i;
+    }
+    if (e.newer >= 0) {
+      entries[e.newer].older = i;
+    } else {
+      tail = i;
+    }
+  }
+  entries.removeLast();
+
+  if (deadChars > chars.size() / 2) {
+    packChars();
+  }
+  return true;
+}
+
+// copies the characters of the remaining keys into a new array
+void VersionTable::packChars()
+{
+  QVector<ushort> packed;
+  packed.reserve(chars.size() - deadChars);
+  for (int i = 0; i < entries.size(); ++i) {
+    Entry &e = entries[i];
+    int offset = packed.size();
+    packed.resize(offset + e.length);
+    memcpy(packed.data() + offset, chars.constData() + e.offset, e.length * sizeof(ushort));
+    e.offset = offset;
+  }
+  chars = packed;
+  deadChars = 0;
+}
+
+// doubles the slots and puts every entry back, the hashes are kept in the entries
+void VersionTable::grow()
+{
+  table.fill(0, 2 * (mask + 1));
+  mask = table.size() - 1;
+  for (int i = 0; i < entries.size(); ++i) {
+    quint32 s = entries.at(i).hash & mask;
+    while (table.at(s)) {
+      s = (s + 1) & mask;
+    }
+    table[s] = i + 1;
+  }
+}
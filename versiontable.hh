@@ -0,0 +1,79 @@
+#ifndef VERSIONTABLE_CLASS_HH
+#define VERSIONTABLE_CLASS_HH
+
+#include <QString>
+#include <QVector>
+
+// Key to version map of a node, an open addressing table with linear
+// probing. The UTF-16 characters of all keys are interned back to back in
+// one array and every key is a 40 byte entry with its version inline, so
+// with its 4 byte table slots a key costs 45 to 51 bytes plus two per
+// character. Entries sit back to back, which makes walking or
+// snapshotting all of them a scan of one array. Removing a key moves the
+// last entry into its place, and the characters are repacked once more
+// than half of them belong to removed keys.
+//
+// Every insert also stamps the entry with the next change sequence number
+// and moves it to the end of a list linked through the entries, so the
+// keys changed after any sequence number are found by walking back from
+// newest() without looking at the others.
+//
+// Every key also belongs to one of a fixed number of buckets, the caller
+// picks which when the key is first inserted, and the entries of a bucket
+// are chained through the entries as well, so no key is stored twice.
+class VersionTable
+{
+  public:
+    VersionTable(int buckets = 1);
+    int value(const QString &key, int defaultVersion = 0) const;
+    void insert(const QString &key, int version, quint32 bucket = 0);
+    bool remove(const QString &key);
+    int size() const;
+
+    // entries by position, 0 .. size() - 1
+    QString keyAt(int i) const;
+    int versionAt(int i) const;
+
+    // change order, -1 past either end
+    quint64 seqAt(int i) const;
+    int oldest() const;
+    int newest() const;
+    int newer(int i) const;
+    int older(int i) const;
+    quint64 lastSeq() const;
+
+    // entries of a bucket in no particular order, -1 past the end
+    int firstIn(quint32 bucket) const;
+    int nextIn(int i) const;
+
+  private:
+    struct Entry
+    {
+      quint32 hash;
+      quint32 offset; // of the key in chars
+      quint32 length;
+      qint32 version;
+      quint32 bucket;
+      qint32 nextInBucket;
+      quint64 seq;
+      qint32 older, newer;
+    };
+
+    int find(const QString &key, quint32 hash) const;
+    void grow();
+    void unlink(int i);
+    void append(int i);
+    void relink(int i, int to);
+    void packChars();
+
+    QVector<Entry> entries;
+    QVector<quint32> table; // entry index + 1, 0 if empty
+    QVector<qint32> buckets; // first entry of every bucket, -1 if empty
+    QVector<ushort> chars;  // interned keys
+    int deadChars;          // of removed keys, still in chars
+    quint32 mask;           // table.size() - 1
+    int head, tail;         // oldest and newest change
+    quint64 seq;            // of the last change
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "versiontracker.hh"
+
+VersionTracker::VersionTracker()
+{
+  versions = new VersionTable(1 << MerkleTree::kDepth);
+  tree = new MerkleTree();
+}
+
+// returns the most recent version of the key, 0 if non existent
+int VersionTracker::findVersion(QString key)
+{
+  return versions->value(key, 0);
+}
+
+// records a newer version of the key, a new key is filed under its tree leaf
+void VersionTracker::setVersion(QString key, int version)
+{
+  quint32 leaf = MerkleTree::leafOf(key);
+  tree->update(leaf, key, findVersion(key), version);
+  versions->insert(key, version, leaf - (1u << MerkleTree::kDepth));
+}
+
+// forgets the key, whatever version it had
+void VersionTracker::removeVersion(QString key)
+{
+  int version = findVersion(key);
+  if (version) {
+    tree->update(MerkleTree::leafOf(key), key, version, 0);
+    versions->remove(key);
+  }
+}
+
+// versions of every key, for a full state exchange
+VersionMap VersionTracker::snapshot() const
+{
+  VersionMap out;
+  for (int i = 0; i < versions->size(); ++i) {
+    out.insert(versions->keyAt(i), versions->versionAt(i));
+  }
+  return out;
+}
+
+// Versions of up to max keys changed after seq, oldest change first.
+// cursor and cursorSeq are left at the newest change returned, if seq is
+// that change on the next call it carries on from there instead of
+// walking back from the newest change.
+VersionMap VersionTracker::changesAfter(quint64 seq, int &cursor, quint64 &cursorSeq, int max)
+{
+  int i;
+  // an entry that was removed meanwhile may have left cursor past the end
+  if (cursor >= 0 and cursor < versions->size() and cursorSeq == seq and
+      versions->seqAt(cursor) == seq) {
+    i = versions->newer(cursor);
+  } else {
+    i = -1;
+    for (int j = versions->newest(); j >= 0 and versions->seqAt(j) > seq; j = versions->older(j)) {
+      i = j;
+    }
+  }
+
+  VersionMap out;
+  for (; i >= 0 and out.size() < max; i = versions->newer(i)) {
+    out.insert(versions->keyAt(i), versions->versionAt(i));
+    cursor = i;
+    cursorSeq = versions->seqAt(i);
+  }
+  return out;
+}
+
+// versions of the keys hashed to any of the tree leaves
+VersionMap VersionTracker::versionsIn(const QVector<quint32> &leaves)
+{
+  VersionMap out;
+  for (int i = 0; i < leaves.size(); ++i) {
+    if (!tree->isLeaf(leaves.at(i))) {
+      continue;
+    }
+    quint32 bucket = leaves.at(i) - (1u << MerkleTree::kDepth);
+    for (int e = versions->firstIn(bucket); e >= 0; e = versions->nextIn(e)) {
+      out.insert(versions->keyAt(e), versions->versionAt(e));
+    }
+  }
+  return out;
+}
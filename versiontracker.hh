@@ -0,0 +1,35 @@
+#ifndef VERSIONTRACKER_CLASS_HH
+#define VERSIONTRACKER_CLASS_HH
+
+#include "merkle.hh"
+#include "message.hh"
+#include "versiontable.hh"
+
+// the versions of the keys a node holds, with the hash tree over them that
+// anti-entropy compares
+class VersionTracker
+{
+  public:
+    VersionTracker();
+    int findVersion(QString key);
+    void setVersion(QString key, int version);
+    void removeVersion(QString key);
+    VersionMap versionsIn(const QVector<quint32> &leaves);
+    VersionMap snapshot() const;
+    VersionMap changesAfter(quint64 seq, int &cursor, quint64 &cursorSeq, int max);
+
+    VersionTable *versions; // key to version
+    MerkleTree *tree;     // hash tree over versions, kept in step with it
+};
+
+// how far a neighbor has caught up with the changes of this node
+struct SyncMark
+{
+  SyncMark() : acked(0), cursor(-1), cursorSeq(0) {}
+
+  quint64 acked;     // it has seen every change up to this one
+  int cursor;        // entry of the newest change sent to it, -1 if none
+  quint64 cursorSeq; // change of that entry when it was sent
+};
+
+#endif